@@ -0,0 +1,42 @@
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include "FileList.h"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+bool listFiles(const string& path, vector<string>& files) {
+	files.clear();
+
+	try {
+		if(fs::is_directory(path)){
+			for(auto it = fs::directory_iterator(path); it != fs::directory_iterator(); it++){
+				if(fs::is_regular_file(it->path())){
+					files.push_back(it->path().string());
+				}
+			}
+			sort(files.begin(), files.end());
+			return true;
+		}
+	} catch(const fs::filesystem_error& ex) {
+		cerr << ex.what() << endl;
+		return false;
+	}
+
+	//otherwise a list file, one input per line
+	ifstream list(path);
+	if(!list){
+		cerr << "Failed to open " << path << endl;
+		return false;
+	}
+	string line;
+	while(getline(list, line)){
+		if(!line.empty()){
+			files.push_back(line);
+		}
+	}
+
+	return true;
+}
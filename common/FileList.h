@@ -0,0 +1,12 @@
+#ifndef _FILE_LIST_H_
+#define _FILE_LIST_H_
+
+#include <string>
+#include <vector>
+
+// The inputs of a batch run: the regular files of a directory in sorted order, or
+// otherwise the non empty lines of a list file. Reports to cerr and returns false
+// when neither can be read.
+bool listFiles(const std::string& path, std::vector<std::string>& files);
+
+#endif // _FILE_LIST_H_
@@ -0,0 +1,162 @@
+#include <fstream>
+#include <algorithm>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "ImageLoader.h"
+#include "Trace.h"
+
+using namespace std;
+using namespace cv;
+
+namespace {
+
+//1 for anything but the supported factors
+int validReduce(int reduce) {
+	return reduce == 2 || reduce == 4 || reduce == 8 ? reduce : 1;
+}
+
+Mat decode(const vector<uchar>& buffer, int flags, int reduce) {
+#if CV_MAJOR_VERSION >= 3
+	//the decoder skips the work itself, JPEG even decodes at the smaller size
+	if(reduce > 1){
+		bool grey = flags == IMREAD_GRAYSCALE;
+		flags = reduce == 2 ? (grey ? IMREAD_REDUCED_GRAYSCALE_2 : IMREAD_REDUCED_COLOR_2)
+			: reduce == 4 ? (grey ? IMREAD_REDUCED_GRAYSCALE_4 : IMREAD_REDUCED_COLOR_4)
+			: (grey ? IMREAD_REDUCED_GRAYSCALE_8 : IMREAD_REDUCED_COLOR_8);
+		reduce = 1;
+	}
+#endif
+	Mat image = imdecode(buffer, flags);
+	if(!image.empty() && reduce > 1){
+		resize(image, image, Size((image.cols + reduce - 1) / reduce, (image.rows + reduce - 1) / reduce), 0, 0, INTER_AREA);
+	}
+	return image;
+}
+
+}
+
+ImageLoader::ImageLoader(const vector<string>& files, const LoadOptions& options) : files(files), options(options) {
+	this->options.depth = std::max<size_t>(1, options.depth);
+	slots.resize(this->options.depth);
+	coarseSlots.resize(this->options.depth);
+	filled.resize(this->options.depth, false);
+	for(size_t s = 0; s < this->options.depth; s++){
+		owner.push_back(s);
+	}
+
+	unsigned threads = std::max(1u, std::min<unsigned>(options.threads, files.size()));
+	for(unsigned i = 0; i < threads; i++){
+		readers.emplace_back(&ImageLoader::work, this);
+	}
+}
+
+ImageLoader::~ImageLoader() {
+	{
+		lock_guard<mutex> lock(mtx);
+		stopping = true;
+	}
+	slotFree.notify_all();
+	for(thread& reader : readers){
+		reader.join();
+	}
+}
+
+void ImageLoader::work() {
+	unique_lock<mutex> lock(mtx);
+	while(!stopping && claimed < files.size()){
+		size_t i = claimed++;
+		size_t s = i % slots.size();
+		//wait for the consumer to take the image depth files back, which frees the slot
+		slotFree.wait(lock, [&]{
+			return stopping || owner[s] == i;
+		});
+		if(stopping){
+			break;
+		}
+
+		lock.unlock();
+		Mat coarse;
+		Mat image = read(files[i], options, coarse);
+		lock.lock();
+
+		slots[s] = image;
+		coarseSlots[s] = coarse;
+		filled[s] = true;
+		slotFilled.notify_all();
+	}
+}
+
+bool ImageLoader::next(LoadedImage& image) {
+	unique_lock<mutex> lock(mtx);
+	if(delivered >= files.size()){
+		return false;
+	}
+	size_t i = delivered++;
+	size_t s = i % slots.size();
+	{
+		TRACE_SPAN("wait for image");
+		slotFilled.wait(lock, [&]{
+			return filled[s] && owner[s] == i;
+		});
+	}
+
+	image.index = i;
+	image.path = files[i];
+	image.image = slots[s];
+	image.coarse = coarseSlots[s];
+	slots[s].release();
+	coarseSlots[s].release();
+	filled[s] = false;
+	owner[s] += slots.size();
+	slotFree.notify_all();
+	return true;
+}
+
+Mat ImageLoader::read(const string& path, const LoadOptions& options) {
+	LoadOptions single = options;
+	single.coarse = 1;
+	Mat coarse;
+	return read(path, single, coarse);
+}
+
+Mat ImageLoader::read(const string& path, int flags) {
+	LoadOptions options;
+	options.flags = flags;
+	return read(path, options);
+}
+
+Mat ImageLoader::read(const string& path, const LoadOptions& options, Mat& coarse) {
+	TRACE_SPAN("load image");
+	coarse.release();
+
+	//one sequential read of the whole file, which suits network mounts far better
+	//than the small reads of the decoders
+	ifstream in(path, ios::binary | ios::ate);
+	if(!in){
+		return Mat();
+	}
+	streamoff size = in.tellg();
+	if(size <= 0){
+		return Mat();
+	}
+	vector<uchar> buffer(size);
+	in.seekg(0);
+	if(!in.read((char*)buffer.data(), size)){
+		return Mat();
+	}
+
+	int reduce = validReduce(options.reduce);
+	Mat image = decode(buffer, options.flags, reduce);
+	int factor = validReduce(options.coarse);
+	if(!image.empty() && factor > 1){
+#if CV_MAJOR_VERSION >= 3
+		//the reduced decode is far cheaper than the full one, so decoding twice beats resizing
+		if(reduce * factor <= 8){
+			coarse = decode(buffer, options.flags, reduce * factor);
+		}
+#endif
+		if(coarse.empty()){
+			resize(image, coarse, Size((image.cols + factor - 1) / factor, (image.rows + factor - 1) / factor), 0, 0, INTER_AREA);
+		}
+	}
+	return image;
+}
@@ -0,0 +1,66 @@
+#ifndef _IMAGE_LOADER_H_
+#define _IMAGE_LOADER_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+struct LoadOptions {
+	int flags = CV_LOAD_IMAGE_COLOR;	// CV_LOAD_IMAGE_GRAYSCALE when only grey is needed
+	int reduce = 1;						// 1, 2, 4 or 8, the image is delivered that much smaller
+	int coarse = 1;						// 2, 4 or 8 to also deliver a copy that much smaller than the image
+	unsigned threads = 4;				// files read and decoded at once
+	size_t depth = 8;					// images held ready ahead of the consumer
+};
+
+struct LoadedImage {
+	size_t index;		// position in the file list
+	std::string path;
+	cv::Mat image;		// empty when the file can't be read or decoded
+	cv::Mat coarse;		// with LoadOptions::coarse, pixel i covers pixels [coarse * i, coarse * (i + 1)) of image
+};
+
+// Reads and decodes a list of images on a small pool of threads ahead of the
+// consumer. Every file is pulled in with one sequential read and decoded from
+// memory, so I/O of the next files overlaps with decoding and with whatever the
+// consumer does. Images come out in list order through a ring of depth slots,
+// the readers stall once they are depth images ahead. next() may be called from
+// several consumer threads.
+class ImageLoader {
+public:
+	explicit ImageLoader(const std::vector<std::string>& files, const LoadOptions& options = LoadOptions());
+	~ImageLoader();
+
+	// false once every image was delivered
+	bool next(LoadedImage& image);
+
+	// synchronous read of one file with the same decoding
+	static cv::Mat read(const std::string& path, const LoadOptions& options = LoadOptions());
+	static cv::Mat read(const std::string& path, int flags);
+	static cv::Mat read(const std::string& path, const LoadOptions& options, cv::Mat& coarse);
+
+	ImageLoader(const ImageLoader&) = delete;
+	ImageLoader& operator=(const ImageLoader&) = delete;
+
+private:
+	void work();
+
+	std::vector<std::string> files;
+	LoadOptions options;
+
+	std::mutex mtx;
+	std::condition_variable slotFree, slotFilled;
+	std::vector<cv::Mat> slots, coarseSlots;
+	std::vector<size_t> owner;		// file each slot holds or waits for, advances by depth when taken
+	std::vector<bool> filled;
+	size_t claimed = 0;		// next file a reader takes
+	size_t delivered = 0;	// next file a consumer gets
+	bool stopping = false;
+	std::vector<std::thread> readers;
+};
+
+#endif // _IMAGE_LOADER_H_
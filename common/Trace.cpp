@@ -0,0 +1,131 @@
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <opencv2/highgui/highgui.hpp>
+#include "Trace.h"
+
+using namespace std;
+
+namespace trace {
+
+atomic<bool> recording(false);
+
+namespace {
+
+struct Event {
+	const char* name;
+	long long begin;
+	long long end;
+};
+
+// one per thread, owned by the registry so the events outlive the thread
+struct ThreadBuffer {
+	int tid;
+	vector<Event> events;
+};
+
+mutex registryMtx;
+vector<shared_ptr<ThreadBuffer> > registry;
+string traceFile;
+string dumpDir;
+atomic<int> dumpCount(0);
+chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+
+ThreadBuffer& localBuffer() {
+	thread_local shared_ptr<ThreadBuffer> buffer;
+	if(!buffer){
+		buffer = make_shared<ThreadBuffer>();
+		lock_guard<mutex> lock(registryMtx);
+		buffer->tid = registry.size() + 1;
+		registry.push_back(buffer);
+	}
+	return *buffer;
+}
+
+}
+
+void init() {
+	const char* file = getenv("HW_TRACE");
+	const char* dir = getenv("HW_TRACE_DUMP");
+	if(dir && *dir){
+		dumpDir = dir;
+	}
+	if(file && *file){
+		start(file);
+		atexit(stop);
+	}
+}
+
+void start(const string& file) {
+	traceFile = file;
+	origin = chrono::steady_clock::now();
+	recording.store(true);
+}
+
+long long now() {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+}
+
+void record(const char* name, long long begin, long long end) {
+	localBuffer().events.push_back(Event{ name, begin, end });
+}
+
+void stop() {
+	if(!recording.exchange(false)){
+		return;
+	}
+
+	//meant to run once the traced threads are done, which is the case at exit
+	ofstream out(traceFile);
+	if(!out){
+		cerr << "Failed to write trace " << traceFile << endl;
+		return;
+	}
+
+	lock_guard<mutex> lock(registryMtx);
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	char buffer[96];
+	for(const shared_ptr<ThreadBuffer>& thread : registry){
+		for(const Event& event : thread->events){
+			//timestamps are in microseconds, three decimals keep the nanoseconds
+			snprintf(buffer, sizeof(buffer), "\"ts\":%lld.%03lld,\"dur\":%lld.%03lld}",
+				event.begin / 1000, event.begin % 1000, (event.end - event.begin) / 1000, (event.end - event.begin) % 1000);
+			out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->tid << ',' << buffer;
+			first = false;
+		}
+	}
+	out << "\n]}" << endl;
+	cout << "Trace saved to " << traceFile << endl;
+}
+
+bool dumping() {
+	return !dumpDir.empty();
+}
+
+bool dump(const string& name, const cv::Mat& image) {
+	if(dumpDir.empty()){
+		return false;
+	}
+
+	//titles may hold paths, keep the file name flat
+	string flat = name;
+	for(char& c : flat){
+		if(!isalnum((unsigned char)c) && c != '-' && c != '.'){
+			c = '_';
+		}
+	}
+
+	char prefix[16];
+	snprintf(prefix, sizeof(prefix), "%04d_", dumpCount++);
+	string file = dumpDir + "/" + prefix + flat + ".png";
+	return cv::imwrite(file, image);
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <atomic>
+#include <string>
+#include <opencv2/core/core.hpp>
+
+// Scoped timing spans written as Chrome trace / Perfetto JSON.
+//
+// Tracing is configured from the environment by trace::init():
+//   HW_TRACE=trace.json     record spans and write them there at exit
+//   HW_TRACE_DUMP=dir       write images passed to trace::dump into dir
+// When disabled a span costs one relaxed atomic load on entry and a branch on exit.
+namespace trace {
+
+extern std::atomic<bool> recording;
+
+void init();
+void start(const std::string& file);
+void stop();
+
+inline bool enabled() {
+	return recording.load(std::memory_order_relaxed);
+}
+
+// nanoseconds since tracing started
+long long now();
+
+void record(const char* name, long long begin, long long end);
+
+// name must outlive the trace, string literals are the intended use
+class Span {
+public:
+	explicit Span(const char* name) : name(name), begin(enabled() ? now() : -1) {}
+	~Span() {
+		if(begin >= 0){
+			record(name, begin, now());
+		}
+	}
+
+	Span(const Span&) = delete;
+	Span& operator=(const Span&) = delete;
+
+private:
+	const char* name;
+	long long begin;
+};
+
+// writes image to HW_TRACE_DUMP if set, returns whether it did
+bool dump(const std::string& name, const cv::Mat& image);
+bool dumping();
+
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#endif // _TRACE_H_
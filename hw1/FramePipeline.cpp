@@ -0,0 +1,213 @@
+#include <memory>
+#include "FramePipeline.h"
+#include "Trace.h"
+
+FramePool::FramePool(uint workers) {
+	if(!workers){
+		workers = max(1u, thread::hardware_concurrency());
+	}
+	for(uint id = 0; id < workers; id++){
+		threads.emplace_back([this]{
+			while(true){
+				function<void()> task;
+				{
+					unique_lock<mutex> lock(mtx);
+					queued.wait(lock, [this]{ return stopping || !tasks.empty(); });
+					if(tasks.empty()){
+						return;
+					}
+					task = move(tasks.front());
+					tasks.pop_front();
+				}
+				task();
+			}
+		});
+	}
+}
+
+FramePool::~FramePool() {
+	{
+		lock_guard<mutex> lock(mtx);
+		stopping = true;
+	}
+	queued.notify_all();
+	for(thread& worker : threads){
+		worker.join();
+	}
+}
+
+void FramePool::submit(function<void()> task) {
+	{
+		lock_guard<mutex> lock(mtx);
+		tasks.push_back(move(task));
+	}
+	queued.notify_one();
+}
+
+FramePipeline::FramePipeline(uint workers, size_t depth) : workers(workers), depth(depth) {
+	if(!this->workers){
+		this->workers = max(1u, thread::hardware_concurrency());
+	}
+	CV_Assert(this->depth > 0);
+}
+
+FramePipeline::FramePipeline(FramePool& pool, size_t depth) : workers(pool.size()), depth(depth), pool(&pool) {
+	CV_Assert(this->depth > 0);
+}
+
+size_t FramePipeline::run(VideoCapture& input, const Stage& process, VideoWriter& output, FrameBudget* budget) {
+	if(pool){
+		return runPooled(input, process, output, budget);
+	}
+
+	vector<unique_ptr<SpscQueue<Mat> > > decoded, processed;
+	for(uint i = 0; i < workers; i++){
+		decoded.emplace_back(new SpscQueue<Mat>(depth));
+		processed.emplace_back(new SpscQueue<Mat>(depth));
+	}
+
+	//an empty Mat marks the end of stream on every queue
+	thread decoder([&]{
+		for(size_t i = 0; ; i++){
+			Mat captured, frame;
+			if(budget){
+				budget->acquire();
+			}
+			{
+				TRACE_SPAN("decode");
+				//with 2.4 the capture hands out a header over its one internal buffer,
+				//which the next decode overwrites while this frame is still queued
+				input >> captured;
+				frame = captured.clone();
+			}
+			if(frame.empty()){
+				if(budget){
+					budget->release();
+				}
+				for(auto& queue : decoded){
+					Mat end;
+					queue->push(end);
+				}
+				break;
+			}
+			decoded[i % workers]->push(frame);
+		}
+	});
+
+	vector<thread> processors;
+	for(uint id = 0; id < workers; id++){
+		processors.emplace_back([&, id]{
+			while(true){
+				Mat frame;
+				decoded[id]->pop(frame);
+				if(frame.empty()){
+					processed[id]->push(frame);
+					break;
+				}
+				{
+					TRACE_SPAN("process");
+					process(frame);
+				}
+				processed[id]->push(frame);
+			}
+		});
+	}
+
+	size_t count = 0;
+	thread encoder([&]{
+		for(size_t i = 0; ; i++){
+			Mat frame;
+			processed[i % workers]->pop(frame);
+			if(frame.empty()){
+				break;
+			}
+			{
+				TRACE_SPAN("encode");
+				output << frame;
+			}
+			count++;
+			if(budget){
+				budget->release();
+			}
+		}
+	});
+
+	decoder.join();
+	for(thread& processor : processors){
+		processor.join();
+	}
+	encoder.join();
+
+	return count;
+}
+
+size_t FramePipeline::runPooled(VideoCapture& input, const Stage& process, VideoWriter& output, FrameBudget* budget) {
+	struct Job {
+		Mat frame;
+		bool done = false;
+	};
+	mutex mtx;
+	condition_variable finished;
+	//jobs in decode order, a null job marks the end of stream
+	SpscQueue<shared_ptr<Job> > order(depth * workers);
+
+	thread decoder([&]{
+		while(true){
+			Mat captured;
+			if(budget){
+				budget->acquire();
+			}
+			{
+				TRACE_SPAN("decode");
+				input >> captured;
+			}
+			if(captured.empty()){
+				if(budget){
+					budget->release();
+				}
+				shared_ptr<Job> end;
+				order.push(end);
+				break;
+			}
+
+			//cloned for the same reason as in run
+			shared_ptr<Job> job = make_shared<Job>();
+			job->frame = captured.clone();
+			pool->submit([&, job]{
+				{
+					TRACE_SPAN("process");
+					process(job->frame);
+				}
+				//notified under the lock, run may return as soon as the last job is seen done
+				lock_guard<mutex> lock(mtx);
+				job->done = true;
+				finished.notify_all();
+			});
+			order.push(job);
+		}
+	});
+
+	size_t count = 0;
+	while(true){
+		shared_ptr<Job> job;
+		order.pop(job);
+		if(!job){
+			break;
+		}
+		{
+			unique_lock<mutex> lock(mtx);
+			finished.wait(lock, [&]{ return job->done; });
+		}
+		{
+			TRACE_SPAN("encode");
+			output << job->frame;
+		}
+		count++;
+		if(budget){
+			budget->release();
+		}
+	}
+	decoder.join();
+
+	return count;
+}
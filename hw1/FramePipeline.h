@@ -0,0 +1,145 @@
+#ifndef _FRAME_PIPELINE_H_
+#define _FRAME_PIPELINE_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <opencv2/highgui/highgui.hpp>
+
+using namespace std;
+using namespace cv;
+
+// bounded single-producer/single-consumer ring, one slot is kept free to tell full from empty
+template<typename T>
+class SpscQueue {
+public:
+	explicit SpscQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+	bool tryPush(T& item) {
+		size_t t = tail.load(memory_order_relaxed);
+		size_t next = (t + 1) % slots.size();
+		if(next == head.load(memory_order_acquire)){
+			return false;
+		}
+		swap(slots[t], item);
+		tail.store(next, memory_order_release);
+		return true;
+	}
+
+	bool tryPop(T& item) {
+		size_t h = head.load(memory_order_relaxed);
+		if(h == tail.load(memory_order_acquire)){
+			return false;
+		}
+		swap(item, slots[h]);
+		slots[h] = T();
+		head.store((h + 1) % slots.size(), memory_order_release);
+		return true;
+	}
+
+	//block on the condition only when the ring is full or empty, an idle side sleeps
+	void push(T& item) {
+		if(!tryPush(item)){
+			unique_lock<mutex> lock(mtx);
+			changed.wait(lock, [&]{ return tryPush(item); });
+		}
+		wake();
+	}
+
+	void pop(T& item) {
+		if(!tryPop(item)){
+			unique_lock<mutex> lock(mtx);
+			changed.wait(lock, [&]{ return tryPop(item); });
+		}
+		wake();
+	}
+
+private:
+	//taking the lock orders the notify after a waiter's check, so no wakeup is lost
+	void wake() {
+		{
+			lock_guard<mutex> lock(mtx);
+		}
+		changed.notify_one();
+	}
+
+	vector<T> slots;
+	atomic<size_t> head;
+	atomic<size_t> tail;
+	mutex mtx;
+	condition_variable changed;
+};
+
+// caps the frames alive at once across several pipelines sharing it
+class FrameBudget {
+public:
+	explicit FrameBudget(size_t frames) : available(frames) {}
+
+	void acquire() {
+		unique_lock<mutex> lock(mtx);
+		released.wait(lock, [this]{ return available > 0; });
+		available--;
+	}
+
+	void release() {
+		{
+			lock_guard<mutex> lock(mtx);
+			available++;
+		}
+		released.notify_one();
+	}
+
+private:
+	mutex mtx;
+	condition_variable released;
+	size_t available;
+};
+
+// processing threads shared by several pipelines, tasks run in submission order
+class FramePool {
+public:
+	explicit FramePool(uint workers = 0);
+	~FramePool();
+
+	uint size() const { return threads.size(); }
+	void submit(function<void()> task);
+
+	FramePool(const FramePool&) = delete;
+	FramePool& operator=(const FramePool&) = delete;
+
+private:
+	mutex mtx;
+	condition_variable queued;
+	deque<function<void()> > tasks;
+	bool stopping = false;
+	vector<thread> threads;
+};
+
+// decode -> N processing workers -> encode, each on its own thread.
+// Frames are dealt to the workers round robin and collected in the same order,
+// so the output keeps the input order without any reordering buffer.
+// On a shared pool the frames go to its threads instead, the calling thread
+// encodes them in decode order once done, and only the decoder thread is added.
+class FramePipeline {
+public:
+	typedef function<void(Mat& frame)> Stage;
+
+	FramePipeline(uint workers = 0, size_t depth = 4);
+	explicit FramePipeline(FramePool& pool, size_t depth = 4);
+
+	// returns the number of frames written, a frame holds one unit of budget from decode until it is encoded
+	size_t run(VideoCapture& input, const Stage& process, VideoWriter& output, FrameBudget* budget = nullptr);
+
+private:
+	size_t runPooled(VideoCapture& input, const Stage& process, VideoWriter& output, FrameBudget* budget);
+
+	uint workers;
+	size_t depth;
+	FramePool* pool = nullptr;
+};
+
+#endif // _FRAME_PIPELINE_H_
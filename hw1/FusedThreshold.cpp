@@ -0,0 +1,160 @@
+#include <cstring>
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+#include "FusedThreshold.h"
+
+//fixed point coefficients used by cvtColor for 8 bit BGR2GRAY
+enum { yuvShift = 14, B2Y = 1868, G2Y = 9617, R2Y = 4899 };
+
+static inline uchar grayOf(uchar b, uchar g, uchar r) {
+	return (uchar)((b * B2Y + g * G2Y + r * R2Y + (1 << (yuvShift - 1))) >> yuvShift);
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+//splits 16 interleaved BGR pixels into one register per channel
+static inline void deinterleave(const uchar* src, __m128i& b, __m128i& g, __m128i& r) {
+	const __m128i s0 = _mm_loadu_si128((const __m128i*)src);
+	const __m128i s1 = _mm_loadu_si128((const __m128i*)(src + 16));
+	const __m128i s2 = _mm_loadu_si128((const __m128i*)(src + 32));
+
+	b = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(s0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+	g = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(s0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+	r = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(s0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+#endif
+
+//thresh must be within [0, 254], the other values give constant rows
+static void binarizeRow(const uchar* src, uchar* dst, int width, int thresh) {
+	int x = 0;
+
+#if defined(__AVX2__) || defined(__SSE4_1__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+	//gray > thresh  <=>  b * B2Y + g * G2Y + r * R2Y + half >= (thresh + 1) << yuvShift
+	const int limit = ((thresh + 1) << yuvShift) - 1;
+#endif
+
+#if defined(__AVX2__)
+	const __m256i bgCoef = _mm256_set1_epi32((G2Y << 16) | B2Y);
+	const __m256i rhCoef = _mm256_set1_epi32(((1 << (yuvShift - 1)) << 16) | R2Y);
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i limits = _mm256_set1_epi32(limit);
+	for(; x <= width - 16; x += 16){
+		__m128i b8, g8, r8;
+		deinterleave(src + x * 3, b8, g8, r8);
+		__m256i b = _mm256_cvtepu8_epi16(b8);
+		__m256i g = _mm256_cvtepu8_epi16(g8);
+		__m256i r = _mm256_cvtepu8_epi16(r8);
+
+		//unpack works per 128 bit lane: lo holds pixels 0-3 and 8-11, hi holds 4-7 and 12-15
+		__m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(b, g), bgCoef), _mm256_madd_epi16(_mm256_unpacklo_epi16(r, one), rhCoef));
+		__m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(b, g), bgCoef), _mm256_madd_epi16(_mm256_unpackhi_epi16(r, one), rhCoef));
+
+		//packing per lane puts the pixels back in order
+		__m256i mask = _mm256_packs_epi32(_mm256_cmpgt_epi32(lo, limits), _mm256_cmpgt_epi32(hi, limits));
+		__m128i result = _mm_packs_epi16(_mm256_castsi256_si128(mask), _mm256_extracti128_si256(mask, 1));
+		_mm_storeu_si128((__m128i*)(dst + x), result);
+	}
+#elif defined(__SSE4_1__)
+	const __m128i bgCoef = _mm_set1_epi32((G2Y << 16) | B2Y);
+	const __m128i rhCoef = _mm_set1_epi32(((1 << (yuvShift - 1)) << 16) | R2Y);
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i limits = _mm_set1_epi32(limit);
+	for(; x <= width - 16; x += 16){
+		__m128i b8, g8, r8;
+		deinterleave(src + x * 3, b8, g8, r8);
+
+		__m128i mask[2];
+		for(int half = 0; half < 2; half++){
+			__m128i b = _mm_cvtepu8_epi16(b8);
+			__m128i g = _mm_cvtepu8_epi16(g8);
+			__m128i r = _mm_cvtepu8_epi16(r8);
+			__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(b, g), bgCoef), _mm_madd_epi16(_mm_unpacklo_epi16(r, one), rhCoef));
+			__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(b, g), bgCoef), _mm_madd_epi16(_mm_unpackhi_epi16(r, one), rhCoef));
+			mask[half] = _mm_packs_epi32(_mm_cmpgt_epi32(lo, limits), _mm_cmpgt_epi32(hi, limits));
+
+			b8 = _mm_srli_si128(b8, 8);
+			g8 = _mm_srli_si128(g8, 8);
+			r8 = _mm_srli_si128(r8, 8);
+		}
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packs_epi16(mask[0], mask[1]));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	//the rounding half is folded into the limit so the compare can stay unsigned
+	const uint32x4_t limits = vdupq_n_u32(limit - (1 << (yuvShift - 1)));
+	for(; x <= width - 16; x += 16){
+		uint8x16x3_t bgr = vld3q_u8(src + x * 3);
+
+		uint16x8_t b16[2] = { vmovl_u8(vget_low_u8(bgr.val[0])), vmovl_u8(vget_high_u8(bgr.val[0])) };
+		uint16x8_t g16[2] = { vmovl_u8(vget_low_u8(bgr.val[1])), vmovl_u8(vget_high_u8(bgr.val[1])) };
+		uint16x8_t r16[2] = { vmovl_u8(vget_low_u8(bgr.val[2])), vmovl_u8(vget_high_u8(bgr.val[2])) };
+
+		uint8x8_t mask[2];
+		for(int half = 0; half < 2; half++){
+			uint32x4_t lo = vmull_n_u16(vget_low_u16(b16[half]), B2Y);
+			lo = vmlal_n_u16(lo, vget_low_u16(g16[half]), G2Y);
+			lo = vmlal_n_u16(lo, vget_low_u16(r16[half]), R2Y);
+			uint32x4_t hi = vmull_n_u16(vget_high_u16(b16[half]), B2Y);
+			hi = vmlal_n_u16(hi, vget_high_u16(g16[half]), G2Y);
+			hi = vmlal_n_u16(hi, vget_high_u16(r16[half]), R2Y);
+
+			mask[half] = vmovn_u16(vcombine_u16(vmovn_u32(vcgtq_u32(lo, limits)), vmovn_u32(vcgtq_u32(hi, limits))));
+		}
+		vst1q_u8(dst + x, vcombine_u8(mask[0], mask[1]));
+	}
+#endif
+
+	for(; x < width; x++){
+		const uchar* p = src + x * 3;
+		dst[x] = grayOf(p[0], p[1], p[2]) > thresh ? 255 : 0;
+	}
+}
+
+void bgrToBinary(const Mat& src, Mat& dst, int thresh, const i18nText::TextLayer* caption, Point pos) {
+	CV_Assert(src.type() == CV_8UC3);
+	dst.create(src.size(), CV_8UC1);
+
+	//caption rows that land inside the frame, in frame coordinates
+	Rect box, clipped;
+	uchar captionValue = 0;
+	if(caption && !caption->mask.empty()){
+		box = Rect(pos + caption->offset, caption->mask.size());
+		clipped = box & Rect(0, 0, src.cols, src.rows);
+		const Vec3b& color = caption->color;
+		captionValue = grayOf(color[0], color[1], color[2]) > thresh ? 255 : 0;
+	}
+
+	for(int y = 0; y < src.rows; y++){
+		uchar* row = dst.ptr<uchar>(y);
+		if(thresh < 0){
+			memset(row, 255, src.cols);
+		} else if(thresh >= 255){
+			memset(row, 0, src.cols);
+		} else{
+			binarizeRow(src.ptr<uchar>(y), row, src.cols, thresh);
+		}
+
+		if(y >= clipped.y && y < clipped.y + clipped.height){
+			const uchar* mask = caption->mask.ptr<uchar>(y - box.y) + (clipped.x - box.x);
+			uchar* out = row + clipped.x;
+			for(int x = 0; x < clipped.width; x++){
+				if(mask[x]){
+					out[x] = captionValue;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef _FUSED_THRESHOLD_H_
+#define _FUSED_THRESHOLD_H_
+
+#include <opencv2/core/core.hpp>
+#include "i18nText.h"
+
+using namespace cv;
+
+// Same result as cvtColor(COLOR_BGR2GRAY) followed by threshold(THRESH_BINARY, maxval = 255),
+// but reads the BGR frame once and writes the binary frame directly.
+// When a caption is given it is composited on the binary output in the same pass,
+// as if it had been drawn on the color frame before conversion.
+void bgrToBinary(const Mat& src, Mat& dst, int thresh, const i18nText::TextLayer* caption = nullptr, Point pos = Point());
+
+#endif // _FUSED_THRESHOLD_H_
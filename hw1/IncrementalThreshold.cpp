@@ -0,0 +1,46 @@
+#include "IncrementalThreshold.h"
+#include "FusedThreshold.h"
+
+IncrementalThreshold::IncrementalThreshold(int thresh, int tileSize, int tolerance, const i18nText::TextLayer* caption, Point pos)
+	: thresh(thresh), tileSize(tileSize), tolerance(tolerance), caption(caption), pos(pos) {
+	CV_Assert(tileSize > 0 && tolerance >= 0);
+}
+
+void IncrementalThreshold::process(const Mat& frame, Mat& binary) {
+	CV_Assert(frame.type() == CV_8UC3);
+
+	int tilesX = (frame.cols + tileSize - 1) / tileSize;
+	int tilesY = (frame.rows + tileSize - 1) / tileSize;
+	tiles += tilesX * tilesY;
+
+	if(reference.size() != frame.size()){
+		bgrToBinary(frame, output, thresh, caption, pos);
+		frame.copyTo(reference);
+		binary = output;
+		return;
+	}
+
+	for(int ty = 0; ty < tilesY; ty++){
+		for(int tx = 0; tx < tilesX; tx++){
+			Rect tile = Rect(tx * tileSize, ty * tileSize, tileSize, tileSize) & Rect(0, 0, frame.cols, frame.rows);
+			Mat current = frame(tile);
+			Mat last = reference(tile);
+
+			if(norm(current, last, NORM_INF) <= tolerance){
+				skipped++;
+				continue;
+			}
+
+			//caption position is relative to the tile, bgrToBinary clips it
+			Mat result = output(tile);
+			bgrToBinary(current, result, thresh, caption, pos - tile.tl());
+			current.copyTo(last);
+		}
+	}
+
+	binary = output;
+}
+
+double IncrementalThreshold::skippedRatio() const {
+	return tiles ? (double)skipped / tiles : 0;
+}
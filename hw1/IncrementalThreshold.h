@@ -0,0 +1,36 @@
+#ifndef _INCREMENTAL_THRESHOLD_H_
+#define _INCREMENTAL_THRESHOLD_H_
+
+#include <opencv2/core/core.hpp>
+#include "i18nText.h"
+
+using namespace cv;
+
+// bgrToBinary for static cameras: the frame is split into tiles and only tiles
+// that changed since they were last converted are run through the kernel again,
+// the rest keep the previous binary output.
+class IncrementalThreshold {
+public:
+	// tolerance is the largest per channel difference still treated as unchanged
+	IncrementalThreshold(int thresh, int tileSize = 32, int tolerance = 0, const i18nText::TextLayer* caption = nullptr, Point pos = Point());
+
+	// binary refers to an internal buffer which is overwritten by the next call
+	void process(const Mat& frame, Mat& binary);
+
+	// fraction of tiles taken from the previous output so far
+	double skippedRatio() const;
+
+private:
+	int thresh;
+	int tileSize;
+	int tolerance;
+	const i18nText::TextLayer* caption;
+	Point pos;
+
+	Mat reference;	// the input each tile was last converted from
+	Mat output;
+	size_t tiles = 0;
+	size_t skipped = 0;
+};
+
+#endif // _INCREMENTAL_THRESHOLD_H_
@@ -0,0 +1,211 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <boost/format.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "i18nText.h"
+#include "FusedThreshold.h"
+
+using namespace std;
+using namespace cv;
+
+typedef chrono::steady_clock Clock;
+
+struct Resolution {
+	string name;
+	Size size;
+};
+
+// per frame timings of one stage, in nanoseconds
+struct Samples {
+	string stage;
+	vector<double> ns;
+
+	double mean() const {
+		double sum = 0;
+		for(double v : ns){
+			sum += v;
+		}
+		return ns.empty() ? 0 : sum / ns.size();
+	}
+
+	double percentile(double p) const {
+		if(ns.empty()){
+			return 0;
+		}
+		vector<double> sorted = ns;
+		size_t k = min(sorted.size() - 1, (size_t)(p * sorted.size()));
+		nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+		return sorted[k];
+	}
+};
+
+template<typename Func>
+inline void timed(Samples& samples, Func func) {
+	auto start = Clock::now();
+	func();
+	samples.ns.push_back(chrono::duration<double, nano>(Clock::now() - start).count());
+}
+
+Mat syntheticFrame(Size size, int index);
+
+int main(int argc, char *argv[]) {
+	CommandLineParser cmd(argc, argv,
+		"{ 1 |           |                  | Recorded video, synthetic frames are used when absent }"
+		"{ n | frames    | 100              | frames measured per resolution }"
+		"{ t | threshold | 128              | Threshold }"
+		"{ o | output    | benchmark.json   | machine readable report }"
+		"{ f | font      | wqy-microhei.ttc | font used to display text }"
+		"{ h | help      | false            | print help message }");
+
+	if(cmd.get<bool>("help")){
+		cout << "Options:" << endl;
+		cmd.printParams();
+		return EXIT_SUCCESS;
+	}
+
+	string inputFile = cmd.get<string>("1");
+	int frames = cmd.get<int>("frames");
+	int thresholdValue = cmd.get<int>("threshold");
+	string reportFile = cmd.get<string>("output");
+
+	vector<Resolution> resolutions {
+		{ "480p", Size(854, 480) },
+		{ "1080p", Size(1920, 1080) },
+		{ "4k", Size(3840, 2160) }
+	};
+
+	//recorded frames are decoded once up front and scaled to every resolution
+	vector<Mat> recorded;
+	if(!inputFile.empty()){
+		VideoCapture input(inputFile);
+		if(!input.isOpened()){
+			cerr << "Failed to open " << inputFile << endl;
+			return EXIT_FAILURE;
+		}
+		Mat frame;
+		while((int)recorded.size() < frames && input.read(frame)){
+			recorded.push_back(frame.clone());
+		}
+		if(recorded.empty()){
+			cerr << "No frame in " << inputFile << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	i18nText i18n(cmd.get<string>("font"), 32);
+	const wstring text = L"黄羽众/3120102663";
+	const Vec3b white(255, 255, 255);
+	i18nText::TextLayer caption = i18n.renderText(text, white);
+
+	ofstream report(reportFile);
+	report << "{\n\t\"frames\": " << frames << ",\n\t\"resolutions\": [";
+
+	for(size_t r = 0; r < resolutions.size(); r++){
+		const Resolution& res = resolutions[r];
+		Point position(res.size.width * 0.05, res.size.height * 0.95);
+		string clip = "benchmark_" + res.name + ".avi";
+
+		vector<Samples> stages {
+			{ "putText" }, { "putLayer" }, { "cvtColor" }, { "threshold" }, { "bgrToBinary" }, { "encode" }, { "decode" }
+		};
+		Samples& putTextStage = stages[0];
+		Samples& putLayerStage = stages[1];
+		Samples& cvtColorStage = stages[2];
+		Samples& thresholdStage = stages[3];
+		Samples& fusedStage = stages[4];
+		Samples& encodeStage = stages[5];
+		Samples& decodeStage = stages[6];
+
+		VideoWriter output(clip, CV_FOURCC('M', 'J', 'P', 'G'), 25, res.size, false);
+		if(!output.isOpened()){
+			cerr << "Failed to open " << clip << endl;
+			return EXIT_FAILURE;
+		}
+
+		for(int i = 0; i < frames; i++){
+			Mat source;
+			if(recorded.empty()){
+				source = syntheticFrame(res.size, i);
+			} else{
+				resize(recorded[i % recorded.size()], source, res.size);
+			}
+
+			Mat overlay = source.clone();
+			timed(putTextStage, [&]{ i18n.putText(overlay, text, position, white); });
+
+			Mat frame = source.clone();
+			timed(putLayerStage, [&]{ i18nText::putLayer(frame, caption, position); });
+
+			Mat gray, binary;
+			timed(cvtColorStage, [&]{ cvtColor(frame, gray, COLOR_BGR2GRAY); });
+			timed(thresholdStage, [&]{ threshold(gray, binary, thresholdValue, 255, THRESH_BINARY); });
+
+			Mat fused;
+			timed(fusedStage, [&]{ bgrToBinary(source, fused, thresholdValue, &caption, position); });
+			if(countNonZero(fused != binary)){
+				cerr << boost::format("bgrToBinary differs from cvtColor + threshold at %1% frame %2%") % res.name % i << endl;
+			}
+
+			timed(encodeStage, [&]{ output << fused; });
+		}
+		output.release();
+
+		VideoCapture input(clip);
+		Mat decoded;
+		for(int i = 0; i < frames; i++){
+			bool ok = true;
+			timed(decodeStage, [&]{ ok = input.read(decoded); });
+			if(!ok){
+				decodeStage.ns.pop_back();
+				break;
+			}
+		}
+		input.release();
+		remove(clip.c_str());
+
+		cout << boost::format("%1% (%2%x%3%):") % res.name % res.size.width % res.size.height << endl;
+		report << (r ? "," : "") << boost::format("\n\t\t{ \"name\": \"%1%\", \"width\": %2%, \"height\": %3%, \"stages\": {") % res.name % res.size.width % res.size.height;
+		for(size_t s = 0; s < stages.size(); s++){
+			const Samples& stage = stages[s];
+			double mean = stage.mean();
+			double fps = mean > 0 ? 1e9 / mean : 0;
+			double p50 = stage.percentile(0.5);
+			double p99 = stage.percentile(0.99);
+
+			cout << boost::format("\t%-12s %12.0f ns/frame %10.1f frames/s  p50 %12.0f ns  p99 %12.0f ns") % stage.stage % mean % fps % p50 % p99 << endl;
+			report << (s ? "," : "") << boost::format("\n\t\t\t\"%1%\": { \"ns_per_frame\": %2%, \"frames_per_second\": %3%, \"p50_ns\": %4%, \"p99_ns\": %5% }")
+				% stage.stage % (long long)mean % fps % (long long)p50 % (long long)p99;
+		}
+		report << "\n\t\t} }";
+	}
+
+	report << "\n\t]\n}" << endl;
+	cout << "Report saved to " << reportFile << endl;
+
+	return EXIT_SUCCESS;
+}
+
+Mat syntheticFrame(Size size, int index) {
+	Mat frame(size, CV_8UC3);
+
+	//a horizontal gradient with a few moving boxes, so frames both compress and change
+	for(int y = 0; y < size.height; y++){
+		Vec3b* row = frame.ptr<Vec3b>(y);
+		for(int x = 0; x < size.width; x++){
+			uchar v = (uchar)(x * 255 / size.width);
+			row[x] = Vec3b(v, (uchar)(y * 255 / size.height), 255 - v);
+		}
+	}
+	for(int k = 0; k < 4; k++){
+		int w = size.width / 8;
+		int x = (index * (k + 1) * 7 + k * w * 2) % (size.width - w);
+		int y = size.height * k / 5;
+		rectangle(frame, Rect(x, y, w, size.height / 6), Scalar(40 * k, 255 - 60 * k, 128), CV_FILLED);
+	}
+
+	return frame;
+}
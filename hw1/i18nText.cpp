@@ -1,4 +1,8 @@
 #include <stdexcept>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "i18nText.h"
 
 i18nText::i18nText() {
@@ -13,15 +17,23 @@ i18nText::i18nText(const string& path, uint size, float space, float gap) : i18n
 }
 
 i18nText::~i18nText() {
-	FT_Done_Face(face);
+	if(face){
+		FT_Done_Face(face);
+	}
 	FT_Done_FreeType(library);
 }
 
 void i18nText::setFont(const string& path) {
-	if(FT_New_Face(library, path.c_str(), 0, &face)){
+	FT_Face newFace;
+	if(FT_New_Face(library, path.c_str(), 0, &newFace)){
 		throw invalid_argument("Failed to load font: " + path);
 	}
+	if(face){
+		FT_Done_Face(face);
+	}
+	face = newFace;
 	FT_Set_Pixel_Sizes(face, size, 0);
+	glyphs.clear();
 }
 
 void i18nText::setStyle(uint size, float space, float gap) {
@@ -29,6 +41,7 @@ void i18nText::setStyle(uint size, float space, float gap) {
 	this->space = space;
 	this->gap = gap;
 	FT_Set_Pixel_Sizes(face, size, 0);
+	glyphs.clear();
 }
 
 void i18nText::putText(Mat& img, const wstring& text, Point pos, Vec3b color) {
@@ -39,7 +52,87 @@ void i18nText::putText(Mat& img, const wstring& text, Point pos, Vec3b color) {
 	}
 }
 
-void i18nText::putWChar(Mat& img, wchar_t wc, Point& pos, Vec3b& color) {
+i18nText::TextLayer i18nText::renderText(const wstring& text, Vec3b color) {
+	int width = 0, height = 0, x = 0;
+	for(const wchar_t& ch : text){
+		const Glyph& glyph = getGlyph(ch);
+		width = max(width, x + glyph.mask.cols);
+		height = max(height, glyph.mask.rows);
+		x += glyph.advance;
+	}
+
+	TextLayer layer;
+	layer.mask = Mat::zeros(height, width, CV_8UC1);
+	layer.offset = Point(0, -(height - 1));
+	layer.color = color;
+
+	//glyphs are bottom aligned to the baseline, same as putWChar
+	x = 0;
+	for(const wchar_t& ch : text){
+		const Glyph& glyph = getGlyph(ch);
+		if(!glyph.mask.empty()){
+			glyph.mask.copyTo(layer.mask(Rect(x, height - glyph.mask.rows, glyph.mask.cols, glyph.mask.rows)));
+		}
+		x += glyph.advance;
+	}
+
+	layer.mask3.create(height, width * 3, CV_8UC1);
+	layer.pixels.create(1, width * 3, CV_8UC1);
+	for(int i = 0; i < height; i++){
+		const uchar* src = layer.mask.ptr<uchar>(i);
+		uchar* dst = layer.mask3.ptr<uchar>(i);
+		for(int j = 0; j < width; j++){
+			dst[j * 3] = dst[j * 3 + 1] = dst[j * 3 + 2] = src[j];
+		}
+	}
+	uchar* pixels = layer.pixels.ptr<uchar>(0);
+	for(int j = 0; j < width; j++){
+		pixels[j * 3] = color[0];
+		pixels[j * 3 + 1] = color[1];
+		pixels[j * 3 + 2] = color[2];
+	}
+
+	return layer;
+}
+
+void i18nText::putLayer(Mat& img, const TextLayer& layer, Point pos) {
+	CV_Assert(!img.empty() && img.type() == CV_8UC3);
+
+	Rect box(pos + layer.offset, layer.mask.size());
+	Rect clipped = box & Rect(0, 0, img.cols, img.rows);
+	if(clipped.area() <= 0){
+		return;
+	}
+
+	int begin = (clipped.x - box.x) * 3;
+	int length = clipped.width * 3;
+	const uchar* pixels = layer.pixels.ptr<uchar>(0) + begin;
+
+	for(int i = 0; i < clipped.height; i++){
+		const uchar* mask = layer.mask3.ptr<uchar>(clipped.y - box.y + i) + begin;
+		uchar* dst = img.ptr<uchar>(clipped.y + i) + clipped.x * 3;
+
+		int j = 0;
+#ifdef __SSE2__
+		for(; j <= length - 16; j += 16){
+			__m128i m = _mm_loadu_si128((const __m128i*)(mask + j));
+			__m128i d = _mm_loadu_si128((const __m128i*)(dst + j));
+			__m128i c = _mm_loadu_si128((const __m128i*)(pixels + j));
+			_mm_storeu_si128((__m128i*)(dst + j), _mm_or_si128(_mm_andnot_si128(m, d), _mm_and_si128(m, c)));
+		}
+#endif
+		for(; j < length; j++){
+			dst[j] = (dst[j] & ~mask[j]) | (pixels[j] & mask[j]);
+		}
+	}
+}
+
+const i18nText::Glyph& i18nText::getGlyph(wchar_t wc) {
+	auto it = glyphs.find(wc);
+	if(it != glyphs.end()){
+		return it->second;
+	}
+
 	FT_UInt glyph_index = FT_Get_Char_Index(face, wc);
 	FT_Load_Glyph(face, glyph_index, FT_LOAD_RENDER | FT_LOAD_MONOCHROME | FT_LOAD_TARGET_MONO);
 	FT_Bitmap bitmap = face->glyph->bitmap;
@@ -47,17 +140,41 @@ void i18nText::putWChar(Mat& img, wchar_t wc, Point& pos, Vec3b& color) {
 	int rows = bitmap.rows;
 	int cols = bitmap.width;
 
+	Glyph glyph;
+	glyph.mask = Mat::zeros(rows, cols, CV_8UC1);
 	for (int i = 0; i < rows; i++) {
+		uchar* dst = glyph.mask.ptr<uchar>(i);
 		for (int j = 0; j < cols; j++) {
 			int off  = i * bitmap.pitch + j / 8;
 			if (bitmap.buffer[off] & (0xC0 >> (j % 8))) {
+				dst[j] = 255;
+			}
+		}
+	}
+	glyph.advance = (int)((cols ? cols : size * space) + size * gap);
+
+	return glyphs.emplace(wc, glyph).first->second;
+}
+
+void i18nText::putWChar(Mat& img, wchar_t wc, Point& pos, Vec3b& color) {
+	const Glyph& glyph = getGlyph(wc);
+
+	int rows = glyph.mask.rows;
+	int cols = glyph.mask.cols;
+
+	for (int i = 0; i < rows; i++) {
+		const uchar* src = glyph.mask.ptr<uchar>(i);
+		for (int j = 0; j < cols; j++) {
+			if (src[j]) {
 				int r = pos.y - (rows - 1 - i);
 				int c = pos.x + j;
 
-				img.at<Vec3b>(r, c) = color;
+				if(r >= 0 && r < img.rows && c >= 0 && c < img.cols){
+					img.at<Vec3b>(r, c) = color;
+				}
 			}
 		}
 	}
 
-	pos.x += (int)((cols ? cols : size * space) + size * gap);
+	pos.x += glyph.advance;
 }
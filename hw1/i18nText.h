@@ -1,6 +1,7 @@
 #ifndef _I18N_TEXT_H_
 #define _I18N_TEXT_H_
 
+#include <unordered_map>
 #include <opencv2/highgui/highgui.hpp>
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -10,6 +11,15 @@ using namespace cv;
 
 class i18nText {
 public:
+	// a whole string rendered once, to be stamped onto frames with putLayer
+	struct TextLayer {
+		Mat mask;		// CV_8UC1, 255 where the text covers
+		Mat mask3;		// mask expanded to one byte per BGR channel
+		Mat pixels;		// one row of the BGR color, as wide as mask3
+		Point offset;	// top-left corner relative to the text origin
+		Vec3b color;
+	};
+
 	i18nText();
 	i18nText(const string& path, uint size = 25, float space = 0.5, float gap = 0.1);
 	~i18nText();
@@ -17,15 +27,25 @@ public:
 	void setFont(const string& path);
 	void setStyle(uint size, float space, float gap);
 	void putText(Mat& img, const wstring& text, Point pos, Vec3b color = Vec3b(0, 0, 0));
+	TextLayer renderText(const wstring& text, Vec3b color = Vec3b(0, 0, 0));
+	static void putLayer(Mat& img, const TextLayer& layer, Point pos);
 
 private:
+	// rendered once per (face, size, codepoint), the cache is dropped whenever face or size changes
+	struct Glyph {
+		Mat mask;
+		int advance;
+	};
+
+	const Glyph& getGlyph(wchar_t wc);
 	void putWChar(Mat& img, wchar_t wc, Point& pos, Vec3b& color);
 
 	FT_Library library;
-	FT_Face face;
+	FT_Face face = nullptr;
 	uint size = 25;
 	float space = 0.5;
 	float gap = 0.1;
+	unordered_map<wchar_t, Glyph> glyphs;
 };
 
 #endif // _I18N_TEXT_H_
@@ -1,19 +1,52 @@
 #include <iostream>
+#include <chrono>
+#include <set>
 #include <boost/format.hpp>
+#include <boost/filesystem.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include "i18nText.h"
+#include "FramePipeline.h"
+#include "FusedThreshold.h"
+#include "IncrementalThreshold.h"
+#include "Trace.h"
+#include "FileList.h"
 
 using namespace std;
 using namespace cv;
+namespace fs = boost::filesystem;
+
+typedef vector<string> Files;
+
+struct Settings {
+	int thresholdValue;
+	bool incremental;
+	int tileSize;
+	int tolerance;
+};
+
+Files outputPaths(const Files& inputFiles, const string& outputDir);
+bool openClip(const string& inputFile, const string& outputFile, VideoCapture& input, VideoWriter& output);
+Point captionPosition(VideoCapture& input);
+size_t convertClip(VideoCapture& input, VideoWriter& output, const i18nText::TextLayer& caption, const Settings& settings, uint workers, double& skipped, FrameBudget* budget = nullptr, FramePool* pool = nullptr);
 
 int main(int argc, char *argv[]) {
+	trace::init();
 	CommandLineParser cmd(argc, argv,
 		"{ 1 |      | input.avi        | Input video }"
 		"{ 2 |      | 128              | Threshold }"
 		"{ 3 |      | output           | Output video }"
 		"{ h | help | false            | print help message }"
-		"{ f | font | wqy-microhei.ttc | font used to display text }");
+		"{ f | font | wqy-microhei.ttc | font used to display text }"
+		"{ b | batch | false | run decode, process and encode on separate threads, implies headless }"
+		"{ w | workers | 0 | processing threads in batch mode, shared by all clips in multi mode, 0 for hardware concurrency }"
+		"{ n | headless | false | don't open the preview window nor wait for display rate }"
+		"{ i | incremental | false | only reconvert tiles that changed since the previous frame }"
+		"{ s | tile | 32 | tile size of incremental mode }"
+		"{ e | tolerance | 0 | largest pixel difference incremental mode treats as unchanged }"
+		"{ m | multi | false | input is a directory or a list file of clips, output is a directory }"
+		"{ c | clips | 2 | clips converted at once in multi mode }"
+		"{ r | frames | 32 | frames in flight across all clips in multi mode }");
 	
 	if(cmd.get<bool>("help")){
 		cout << "Options:" << endl;
@@ -23,20 +56,160 @@ int main(int argc, char *argv[]) {
 
 	string title = "Threshold";
 	string inputFile = cmd.get<string>("1");
-	int thresholdValue = cmd.get<int>("2");
 	string outputFile = cmd.get<string>("3");
 	string font = cmd.get<string>("font");
+	bool batch = cmd.get<bool>("batch");
+	uint workers = cmd.get<uint>("workers");
+	bool headless = batch || cmd.get<bool>("headless");
 
-	VideoCapture input(inputFile);
-	if(!input.isOpened()){
-		cerr << "Failed to open " << inputFile << endl;
-		return EXIT_FAILURE;
+	Settings settings;
+	settings.thresholdValue = cmd.get<int>("2");
+	settings.incremental = cmd.get<bool>("incremental");
+	settings.tileSize = cmd.get<int>("tile");
+	settings.tolerance = cmd.get<int>("tolerance");
+
+	i18nText i18n(font, 32);
+	i18nText::TextLayer caption = i18n.renderText(L"黄羽众/3120102663", Vec3b(255, 255, 255));
+
+	if(cmd.get<bool>("multi")){
+		uint clips = max(1u, cmd.get<uint>("clips"));
+
+		Files inputFiles;
+		if(!listFiles(inputFile, inputFiles)){
+			return EXIT_FAILURE;
+		}
+		Files outputFiles = outputPaths(inputFiles, outputFile);
+		try {
+			fs::create_directories(outputFile);
+		} catch(const fs::filesystem_error& ex) {
+			cerr << ex.what() << endl;
+			return EXIT_FAILURE;
+		}
+		cout << boost::format("Converting %1% clips to %2% with threshold = %3% ...") % inputFiles.size() % outputFile % settings.thresholdValue << endl;
+
+		//clips share the caption layer, which is read only once rendered, and one
+		//pool of processing threads, so more clips don't mean more busy threads
+		FrameBudget budget(max(1u, cmd.get<uint>("frames")));
+		FramePool framePool(workers);
+		atomic<size_t> next(0), frames(0), failed(0);
+		mutex coutMtx;
+		auto start = chrono::steady_clock::now();
+
+		vector<thread> pool;
+		for(uint id = 0; id < clips; id++){
+			pool.emplace_back([&]{
+				for(size_t i = next++; i < inputFiles.size(); i = next++){
+					const string& clipOutput = outputFiles[i];
+
+					VideoCapture input;
+					VideoWriter output;
+					if(!openClip(inputFiles[i], clipOutput, input, output)){
+						lock_guard<mutex> lock(coutMtx);
+						cerr << "Failed to convert " << inputFiles[i] << endl;
+						failed++;
+						continue;
+					}
+
+					double skipped;
+					size_t count = convertClip(input, output, caption, settings, workers, skipped, &budget, &framePool);
+					frames += count;
+
+					lock_guard<mutex> lock(coutMtx);
+					cout << boost::format("Converted %1% to %2%, %3% frames") % inputFiles[i] % clipOutput % count << endl;
+					if(settings.incremental){
+						cout << boost::format("Skipped %1%%% of tiles in %2%") % (skipped * 100) % inputFiles[i] << endl;
+					}
+				}
+			});
+		}
+		for(thread& worker : pool){
+			worker.join();
+		}
+
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		cout << boost::format("Total: %1% clips, %2% failed, %3% frames in %4% s, %5% frames/s") % inputFiles.size() % failed.load() % frames.load() % seconds % (frames.load() / seconds) << endl;
+		return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 	}
 
 	if(outputFile.rfind('.') == string::npos){
 		outputFile += inputFile.substr(inputFile.rfind('.'));
 	}
-	VideoWriter output(
+
+	VideoCapture input;
+	VideoWriter output;
+	if(!openClip(inputFile, outputFile, input, output)){
+		return EXIT_FAILURE;
+	}
+
+	int interval = 1000 / input.get(CV_CAP_PROP_FPS);
+	cout << boost::format("Converting %1% to %2% with threshold = %3% ...") % inputFile % outputFile % settings.thresholdValue << endl;
+
+	if(batch){
+		double skipped;
+		size_t count = convertClip(input, output, caption, settings, workers, skipped);
+		cout << boost::format("Converted %1% frames") % count << endl;
+		if(settings.incremental){
+			cout << boost::format("Skipped %1%%% of tiles") % (skipped * 100) << endl;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	Point position = captionPosition(input);
+	IncrementalThreshold tiled(settings.thresholdValue, settings.tileSize, settings.tolerance, &caption, position);
+
+	Mat frame;
+	if(!headless){
+		namedWindow(title, CV_WINDOW_AUTOSIZE);
+	}
+
+	while(true){
+		input >> frame;
+		if(frame.empty()){
+			break;
+		}
+		Mat binary;
+		if(settings.incremental){
+			tiled.process(frame, binary);
+		} else{
+			bgrToBinary(frame, binary, settings.thresholdValue, &caption, position);
+		}
+		output << binary;
+		if(!headless){
+			imshow(title, binary);
+			waitKey(interval);
+		}
+	}
+	if(settings.incremental){
+		cout << boost::format("Skipped %1%%% of tiles") % (tiled.skippedRatio() * 100) << endl;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+Files outputPaths(const Files& inputFiles, const string& outputDir) {
+	//clips from different directories may share a name, the later ones get a number
+	//before the extension so no output overwrites another
+	set<string> taken;
+	Files outputs;
+	for(const string& file : inputFiles){
+		fs::path path(file);
+		string name = path.filename().string();
+		for(int n = 1; !taken.insert(name).second; n++){
+			name = path.stem().string() + "_" + to_string(n) + path.extension().string();
+		}
+		outputs.push_back((fs::path(outputDir) / name).string());
+	}
+	return outputs;
+}
+
+bool openClip(const string& inputFile, const string& outputFile, VideoCapture& input, VideoWriter& output) {
+	input.open(inputFile);
+	if(!input.isOpened()){
+		cerr << "Failed to open " << inputFile << endl;
+		return false;
+	}
+
+	output.open(
 		outputFile,
 		input.get(CV_CAP_PROP_FOURCC),
 		input.get(CV_CAP_PROP_FPS) * 2,
@@ -45,32 +218,39 @@ int main(int argc, char *argv[]) {
 	);
 	if(!output.isOpened()){
 		cerr << "Failed to open " << outputFile << endl;
-		return EXIT_FAILURE;
+		return false;
 	}
 
-	i18nText i18n(font, 32);
-	int interval = 1000 / input.get(CV_CAP_PROP_FPS);
-	Point position(
+	return true;
+}
+
+Point captionPosition(VideoCapture& input) {
+	return Point(
 		input.get(CV_CAP_PROP_FRAME_WIDTH) * 0.05,
 		input.get(CV_CAP_PROP_FRAME_HEIGHT) * 0.95
 	);
-	cout << boost::format("Converting %1% to %2% with threshold = %3% ...") % inputFile % outputFile % thresholdValue << endl;
+}
 
-	Mat frame;
-	namedWindow(title, CV_WINDOW_AUTOSIZE);
+size_t convertClip(VideoCapture& input, VideoWriter& output, const i18nText::TextLayer& caption, const Settings& settings, uint workers, double& skipped, FrameBudget* budget, FramePool* pool) {
+	Point position = captionPosition(input);
+	IncrementalThreshold tiled(settings.thresholdValue, settings.tileSize, settings.tolerance, &caption, position);
 
-	while(true){
-		input >> frame;
-		if(frame.empty()){
-			break;
+	auto process = [&](Mat& frame){
+		Mat binary;
+		if(settings.incremental){
+			//the output buffer is reused, so hand out a copy that may still be queued
+			tiled.process(frame, binary);
+			frame = binary.clone();
+		} else{
+			bgrToBinary(frame, binary, settings.thresholdValue, &caption, position);
+			frame = binary;
 		}
-		i18n.putText(frame, L"黄羽众/3120102663", position, Vec3b(255, 255, 255));
-		cvtColor(frame, frame, COLOR_BGR2GRAY);
-		threshold(frame, frame, thresholdValue, 255, THRESH_BINARY);
-		imshow(title, frame);
-		output << frame;
-		waitKey(interval);
-	}
+	};
 
-	return EXIT_SUCCESS;
+	//incremental mode depends on the previous frame, so it can't fan out, not even to a shared pool
+	FramePipeline pipeline = settings.incremental ? FramePipeline(1) : pool ? FramePipeline(*pool) : FramePipeline(workers);
+	size_t count = pipeline.run(input, process, output, budget);
+	skipped = tiled.skippedRatio();
+
+	return count;
 }
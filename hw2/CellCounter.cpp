@@ -0,0 +1,267 @@
+#include <iostream>
+#include <algorithm>
+#include <boost/format.hpp>
+#include <boost/accumulators/accumulators.hpp>
+#include <boost/accumulators/statistics/stats.hpp>
+#include <boost/accumulators/statistics/min.hpp>
+#include <boost/accumulators/statistics/max.hpp>
+#include <boost/accumulators/statistics/count.hpp>
+#include <boost/accumulators/statistics/mean.hpp>
+#include <boost/accumulators/statistics/variance.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "CellCounter.h"
+#include "ContourTable.h"
+#include "TiledSlide.h"
+#include "KMeans1D.h"
+#include "ComponentStats.h"
+#include "Preprocess.h"
+#include "Trace.h"
+#include "ImageLoader.h"
+
+using namespace boost;
+using namespace boost::accumulators;
+
+typedef vector<Point> Contour;
+const int borderS = 10;
+
+static float lloydSmallMean(const vector<int>& candidates, const vector<float>& cellArea, bool verbose) {
+	accumulator_set<float, stats<tag::min, tag::max, tag::mean> > initAcc;
+	for(int i : candidates){
+		initAcc(cellArea[i]);
+	}
+	float smallMean = accumulators::min(initAcc);
+	float middleMean = accumulators::mean(initAcc);
+	float bigMean = accumulators::max(initAcc);
+	float distance = FLT_MAX;
+
+	if(verbose){
+		cout << "Running K-means..." << endl;
+	}
+	while(true){
+		if(verbose){
+			cout << boost::format("SmallMean: %1%, MiddleMean: %2%, bigMean: %3%, distance: %4%") % smallMean % middleMean % bigMean % distance << endl;
+		}
+		float smallLimit = (smallMean + middleMean) / 2;
+		float bigLimit = (middleMean + bigMean) / 2;
+		accumulator_set<float, stats<tag::count, tag::mean, tag::variance> > smallAcc;
+		accumulator_set<float, stats<tag::count, tag::mean, tag::variance> > middleAcc;
+		accumulator_set<float, stats<tag::count, tag::mean, tag::variance> > bigAcc;
+		for(int i : candidates){
+			float area = cellArea[i];
+			if(area < smallLimit){
+				smallAcc(area);
+			} else{
+				if(area > bigLimit){
+					bigAcc(area);
+				} else{
+					middleAcc(area);
+				}
+			}
+		}
+
+		float _smallMean = accumulators::mean(smallAcc);
+		float _middleMean = accumulators::mean(middleAcc);
+		float _bigMean = accumulators::mean(bigAcc);
+		float _distance = accumulators::variance(smallAcc) * accumulators::count(smallAcc)
+						+ accumulators::variance(middleAcc) * accumulators::count(middleAcc)
+						+ accumulators::variance(bigAcc) * accumulators::count(bigAcc);
+
+		if(distance > _distance){
+			smallMean = _smallMean;
+			middleMean = _middleMean;
+			bigMean = _bigMean;
+			distance = _distance;
+		} else{
+			break;
+		}
+	}
+
+	return smallMean;
+}
+
+bool countCells(const string& path, const CellOptions& options, CellReport& report, const DebugView& show, const Mat& preloaded) {
+	TRACE_SPAN("countCells");
+	ContourTable table;
+	ComponentTable components;
+	Mat step;
+
+	CV_Assert(!(options.components && options.tileSize > 0));
+
+	if(options.tileSize > 0){
+		//no debug windows here, the slide would not fit in them anyway
+		unique_ptr<SlideSource> slide = SlideSource::open(path);
+		if(!slide){
+			return false;
+		}
+
+		TileOptions tileOptions;
+		tileOptions.tileSize = options.tileSize;
+		tileOptions.overlap = options.overlap;
+		tileOptions.workers = options.workers;
+		TRACE_SPAN("findCellsTiled");
+		findCellsTiled(*slide, tileOptions, borderS, table);
+	} else{
+		Mat src = preloaded.empty() ? ImageLoader::read(path) : preloaded;
+		if(src.empty()){
+			return false;
+		}
+
+		if(show){
+			show("Source", src);
+		}
+
+		if(options.fused || !show){
+			TRACE_SPAN("preprocessFused");
+			preprocessFused(src, step, borderS, options.workers);
+		} else{
+			{
+				TRACE_SPAN("cvtColor");
+				cvtColor(src, step, COLOR_BGR2GRAY);
+			}
+			show("Grey", step);
+
+			{
+				TRACE_SPAN("dilate");
+				dilate(step, step, getStructuringElement(MORPH_ELLIPSE, Size(3, 3)));
+			}
+			show("Dilation", step);
+
+			{
+				TRACE_SPAN("normalize");
+				normalize(step, step, 0, 255, NORM_MINMAX);
+			}
+			show("Normalize", step);
+
+			{
+				TRACE_SPAN("GaussianBlur");
+				GaussianBlur(step, step, Size(3, 3), 0);
+			}
+			show("GaussianBlur", step);
+
+			{
+				TRACE_SPAN("threshold");
+				threshold(step, step, 0, 255, THRESH_BINARY | THRESH_OTSU);
+			}
+			show("Threshold", step);
+
+			TRACE_SPAN("copyMakeBorder");
+			copyMakeBorder(step, step, borderS, borderS, borderS, borderS, BORDER_CONSTANT, CV_RGB(255, 255, 255));
+		}
+		if(show){
+			show("MakeBorder", step);
+		}
+
+		if(options.components){
+			TRACE_SPAN("measureHoles");
+			measureHoles(step, components, options.workers);
+		} else{
+			vector<Contour> rawContours;
+			vector<Vec4i> hierarchy;
+
+			{
+				TRACE_SPAN("findContours");
+				findContours(step, rawContours, hierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE);
+			}
+			if(show){
+				step = Mat::zeros(step.size(), CV_8UC1);
+				drawContours(step, rawContours, -1, CV_RGB(255, 255, 255));
+				show("RawContours", step);
+			}
+
+			TRACE_SPAN("ContourTable::build");
+			table.build(rawContours, hierarchy);
+			vector<Contour>().swap(rawContours);
+		}
+	}
+
+	//both engines expose the same per cell measurements
+	bool useComponents = options.components;
+	const vector<float>& cellArea = useComponents ? components.area : table.area;
+	const vector<int>& cellParent = useComponents ? components.parent : table.parent;
+	auto describe = [&](int i){
+		RotatedRect box = useComponents ? components.box(i) : fitEllipse(table.contour(i));
+		Cell cell;
+		cell.area = cellArea[i];
+		cell.arcLength = useComponents ? (double)components.perimeter[i] : arcLength(table.contour(i), true);
+		cell.orientation = box.angle;
+		cell.center = box.center - Point2f(borderS, borderS);
+		return cell;
+	};
+
+	vector<int> candidates;
+	for(int i = cellArea.size() - 1; i >= 0; i--){
+		if(useComponents ? cellArea[i] < 5 : table.length(i) < 5){
+			continue;
+		}
+		if(cellParent[i] >= 0){
+			candidates.push_back(i);
+		}
+	}
+	if(candidates.empty()){
+		return false;
+	}
+
+	// k-means part
+	{
+		TRACE_SPAN("kmeans");
+		if(options.kmeans == "exact" || options.kmeans == "histogram"){
+			vector<float> areas;
+			areas.reserve(candidates.size());
+			for(int i : candidates){
+				areas.push_back(cellArea[i]);
+			}
+			ThreeMeans means = options.kmeans == "exact" ? threeMeansExact(areas) : threeMeansHistogram(areas);
+			if(options.verbose){
+				cout << boost::format("SmallMean: %1%, MiddleMean: %2%, bigMean: %3%, distance: %4%") % means.smallMean % means.middleMean % means.bigMean % means.distance << endl;
+			}
+			report.minValidSize = means.smallMean;
+		} else{
+			report.minValidSize = lloydSmallMean(candidates, cellArea, options.verbose);
+		}
+	}
+
+	candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](int i){
+		return cellArea[i] < report.minValidSize;
+	}), candidates.end());
+
+	int maxCell = candidates.front();
+	int minCell = maxCell;
+
+	accumulator_set<float, stats<tag::mean> > finalAcc;
+	for(int i : candidates){
+		if(cellArea[i] > cellArea[maxCell]){
+			maxCell = i;
+		}
+		if(cellArea[i] < cellArea[minCell]){
+			minCell = i;
+		}
+		finalAcc(cellArea[i]);
+	}
+
+	report.count = candidates.size();
+	report.meanArea = accumulators::mean(finalAcc);
+	report.maxCell = describe(maxCell);
+	report.minCell = describe(minCell);
+	report.cells.clear();
+	if(options.allCells){
+		report.cells.reserve(candidates.size());
+		for(int i : candidates){
+			report.cells.push_back(describe(i));
+		}
+	}
+
+	if(show && !step.empty()){
+		step = Mat::zeros(step.size(), CV_8UC1);
+		if(useComponents){
+			for(int i : candidates){
+				ellipse(step, components.box(i), CV_RGB(255, 255, 255));
+			}
+		} else{
+			table.draw(step, candidates, CV_RGB(255, 255, 255));
+		}
+		show("FilteredContours", step);
+	}
+
+	return true;
+}
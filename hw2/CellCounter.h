@@ -0,0 +1,46 @@
+#ifndef _CELL_COUNTER_H_
+#define _CELL_COUNTER_H_
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+// receives intermediate images for display, left empty when running headless
+typedef function<void(const string& title, const Mat& image)> DebugView;
+
+struct CellOptions {
+	int tileSize = 0;			// 0 for the whole image at once
+	int overlap = 64;
+	uint workers = 0;			// threads for tiles or bands, 0 for hardware concurrency
+	string kmeans = "exact";	// lloyd, exact or histogram
+	bool components = false;	// one pass moments instead of contours
+	bool fused = false;			// banded preprocessing
+	bool verbose = true;		// print k-means progress
+	bool allCells = false;		// describe every cell, not only the extremes
+};
+
+struct Cell {
+	float area;
+	double arcLength;
+	float orientation;
+	Point2f center;		// in source image coordinates
+};
+
+struct CellReport {
+	size_t count = 0;
+	float minValidSize = 0;
+	double meanArea = 0;
+	Cell maxCell, minCell;
+	vector<Cell> cells;		// only filled with allCells
+};
+
+// Runs the whole cell counting pipeline on one slide. Returns false when the slide
+// can't be read or holds no cell. A caller that already decoded the slide passes it
+// as preloaded, tiled runs always stream from path.
+bool countCells(const string& path, const CellOptions& options, CellReport& report, const DebugView& show = DebugView(), const Mat& preloaded = Mat());
+
+#endif // _CELL_COUNTER_H_
@@ -0,0 +1,283 @@
+#include <cmath>
+#include <climits>
+#include <thread>
+#include <algorithm>
+#include "ComponentStats.h"
+
+namespace {
+
+enum { imageTop = -1, stripTop = -2 };
+
+// running sums of one provisional label
+struct Accum {
+	int64 n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+	int64 cracks = 0;
+	int minX = INT_MAX, minY = INT_MAX, maxX = -1, maxY = -1;
+	int64 first = -1;		// raster index of the first pixel
+	int above = imageTop;	// label of the foreground pixel right above the first pixel
+	bool zero = false;
+	bool border = false;
+
+	void add(int x, int y) {
+		n++;
+		sx += x;
+		sy += y;
+		sxx += (int64)x * x;
+		sxy += (int64)x * y;
+		syy += (int64)y * y;
+		minX = std::min(minX, x);
+		minY = std::min(minY, y);
+		maxX = std::max(maxX, x);
+		maxY = std::max(maxY, y);
+	}
+
+	void merge(const Accum& other) {
+		n += other.n;
+		sx += other.sx;
+		sy += other.sy;
+		sxx += other.sxx;
+		sxy += other.sxy;
+		syy += other.syy;
+		cracks += other.cracks;
+		minX = std::min(minX, other.minX);
+		minY = std::min(minY, other.minY);
+		maxX = std::max(maxX, other.maxX);
+		maxY = std::max(maxY, other.maxY);
+		if(first < 0 || (other.first >= 0 && other.first < first)){
+			first = other.first;
+			above = other.above;
+		}
+		zero = other.zero;
+		border = border || other.border;
+	}
+};
+
+int findRoot(vector<int>& uf, int label) {
+	while(uf[label] != label){
+		uf[label] = uf[uf[label]];
+		label = uf[label];
+	}
+	return label;
+}
+
+void unite(vector<int>& uf, int a, int b) {
+	a = findRoot(uf, a);
+	b = findRoot(uf, b);
+	if(a != b){
+		uf[std::max(a, b)] = std::min(a, b);
+	}
+}
+
+struct Strip {
+	int begin, end;
+	vector<Accum> accums;
+	vector<int> uf;
+	vector<int> firstRow, lastRow;
+};
+
+// zero pixels join their left and upper neighbours, foreground pixels all four
+// already visited 8-neighbours. Only the previous row of labels is kept.
+void labelStrip(const Mat& binary, Strip& strip) {
+	int rows = binary.rows, cols = binary.cols;
+	vector<int> prev(cols, -1), cur(cols, -1);
+
+	for(int y = strip.begin; y < strip.end; y++){
+		const uchar* row = binary.ptr<uchar>(y);
+		const uchar* up = y > strip.begin ? binary.ptr<uchar>(y - 1) : nullptr;
+
+		for(int x = 0; x < cols; x++){
+			bool zero = !row[x];
+			int label = -1;
+			auto join = [&](int other){
+				if(label < 0){
+					label = other;
+				} else{
+					unite(strip.uf, label, other);
+				}
+			};
+
+			if(x > 0 && !row[x - 1] == zero){
+				join(cur[x - 1]);
+			}
+			if(up){
+				if(!up[x] == zero){
+					join(prev[x]);
+				}
+				if(!zero){
+					if(x > 0 && up[x - 1]){
+						join(prev[x - 1]);
+					}
+					if(x < cols - 1 && up[x + 1]){
+						join(prev[x + 1]);
+					}
+				}
+			}
+
+			if(label < 0){
+				label = strip.accums.size();
+				strip.accums.push_back(Accum());
+				strip.uf.push_back(label);
+				Accum& fresh = strip.accums.back();
+				fresh.zero = zero;
+				fresh.first = (int64)y * cols + x;
+				fresh.above = up ? prev[x] : (y == 0 ? (int)imageTop : (int)stripTop);
+			}
+			cur[x] = label;
+
+			Accum& accum = strip.accums[label];
+			accum.add(x, y);
+
+			//cracks between a hole and anything else, counted on the hole side
+			if(zero){
+				if(x == 0 || y == 0 || x == cols - 1 || y == rows - 1){
+					accum.border = true;
+				}
+				accum.cracks += (x == 0) + (x == cols - 1) + (y == 0) + (y == rows - 1);
+				if(x > 0 && row[x - 1]){
+					accum.cracks++;
+				}
+				if(up && up[x]){
+					accum.cracks++;
+				}
+			} else{
+				if(x > 0 && !row[x - 1]){
+					strip.accums[cur[x - 1]].cracks++;
+				}
+				if(up && !up[x]){
+					strip.accums[prev[x]].cracks++;
+				}
+			}
+		}
+
+		if(y == strip.begin){
+			strip.firstRow = cur;
+		}
+		swap(prev, cur);
+	}
+	strip.lastRow = prev;
+}
+
+}
+
+void measureHoles(const Mat& binary, ComponentTable& table, uint strips) {
+	CV_Assert(binary.type() == CV_8UC1);
+
+	int rows = binary.rows, cols = binary.cols;
+	if(!strips){
+		strips = std::max(1u, thread::hardware_concurrency());
+	}
+	strips = std::max(1u, std::min(strips, (uint)std::max(1, rows)));
+
+	vector<Strip> parts(strips);
+	vector<thread> workers;
+	for(uint s = 0; s < strips; s++){
+		parts[s].begin = rows * s / strips;
+		parts[s].end = rows * (s + 1) / strips;
+		workers.emplace_back([&, s]{ labelStrip(binary, parts[s]); });
+	}
+	for(thread& worker : workers){
+		worker.join();
+	}
+
+	//one label space over all strips
+	vector<int> offset(strips + 1, 0);
+	for(uint s = 0; s < strips; s++){
+		offset[s + 1] = offset[s] + parts[s].accums.size();
+	}
+	vector<int> uf(offset[strips]);
+	vector<Accum> accums(offset[strips]);
+	for(uint s = 0; s < strips; s++){
+		for(size_t l = 0; l < parts[s].accums.size(); l++){
+			uf[offset[s] + l] = offset[s] + parts[s].uf[l];
+			Accum& accum = accums[offset[s] + l];
+			accum = parts[s].accums[l];
+			if(accum.above == stripTop){
+				int x = accum.first % cols;
+				accum.above = offset[s - 1] + parts[s - 1].lastRow[x];
+			} else if(accum.above >= 0){
+				accum.above += offset[s];
+			}
+		}
+		vector<Accum>().swap(parts[s].accums);
+	}
+
+	//seams: the same joins and cracks labelStrip does between two rows
+	for(uint s = 1; s < strips; s++){
+		if(parts[s].begin == parts[s].end || parts[s - 1].begin == parts[s - 1].end){
+			continue;
+		}
+		const uchar* up = binary.ptr<uchar>(parts[s].begin - 1);
+		const uchar* row = binary.ptr<uchar>(parts[s].begin);
+		const vector<int>& upLabels = parts[s - 1].lastRow;
+		const vector<int>& labels = parts[s].firstRow;
+
+		for(int x = 0; x < cols; x++){
+			int label = offset[s] + labels[x];
+			int upLabel = offset[s - 1] + upLabels[x];
+			if(!row[x] == !up[x]){
+				unite(uf, label, upLabel);
+			} else if(!row[x]){
+				accums[label].cracks++;
+			} else{
+				accums[upLabel].cracks++;
+			}
+			if(row[x]){
+				if(x > 0 && up[x - 1]){
+					unite(uf, label, offset[s - 1] + upLabels[x - 1]);
+				}
+				if(x < cols - 1 && up[x + 1]){
+					unite(uf, label, offset[s - 1] + upLabels[x + 1]);
+				}
+			}
+		}
+	}
+
+	//fold every provisional label into its root
+	for(size_t l = 0; l < accums.size(); l++){
+		int root = findRoot(uf, l);
+		if(root != (int)l){
+			accums[root].merge(accums[l]);
+		}
+	}
+
+	vector<int> regionIndex(accums.size(), -1);
+	int regions = 0;
+	vector<int> holes;
+	for(size_t l = 0; l < accums.size(); l++){
+		if(uf[l] != (int)l){
+			continue;
+		}
+		if(accums[l].zero){
+			holes.push_back(l);
+		} else{
+			regionIndex[l] = regions++;
+		}
+	}
+	sort(holes.begin(), holes.end(), [&](int a, int b){
+		return accums[a].first < accums[b].first;
+	});
+
+	table = ComponentTable();
+	for(int l : holes){
+		const Accum& accum = accums[l];
+		double n = accum.n;
+		double cx = accum.sx / n, cy = accum.sy / n;
+		double mu20 = accum.sxx / n - cx * cx;
+		double mu02 = accum.syy / n - cy * cy;
+		double mu11 = accum.sxy / n - cx * cy;
+		double half = std::sqrt((mu20 - mu02) * (mu20 - mu02) / 4 + mu11 * mu11);
+		double lambda1 = (mu20 + mu02) / 2 + half;
+		double lambda2 = std::max(0., (mu20 + mu02) / 2 - half);
+		//the minor axis is a quarter turn from the major one, kept in (0, 180] like fitEllipse
+		double minorAngle = 0.5 * std::atan2(2 * mu11, mu20 - mu02) * 180 / CV_PI + 90;
+
+		table.area.push_back(n);
+		table.center.push_back(Point2f(cx, cy));
+		table.angle.push_back(minorAngle > 0 ? minorAngle : minorAngle + 180);
+		table.majorAxis.push_back(4 * std::sqrt(lambda1));
+		table.minorAxis.push_back(4 * std::sqrt(lambda2));
+		table.perimeter.push_back(accum.cracks * CV_PI / 4);
+		table.parent.push_back(accum.border || accum.above < 0 ? -1 : regionIndex[findRoot(uf, accum.above)]);
+		table.bbox.push_back(Rect(accum.minX, accum.minY, accum.maxX - accum.minX + 1, accum.maxY - accum.minY + 1));
+	}
+}
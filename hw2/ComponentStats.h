@@ -0,0 +1,35 @@
+#ifndef _COMPONENT_STATS_H_
+#define _COMPONENT_STATS_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+// Statistics of the holes of a binary image (4-connected zero regions), the
+// regions CV_RETR_CCOMP reports as contours with a parent, without tracing contours.
+struct ComponentTable {
+	vector<float> area;			// pixel count
+	vector<Point2f> center;		// centroid
+	vector<float> angle;		// degrees in (0, 180], direction of the minor axis as fitEllipse reports it
+	vector<float> majorAxis;	// full axes of the ellipse with the same moments
+	vector<float> minorAxis;
+	vector<float> perimeter;	// crack length scaled by pi/4
+	vector<int> parent;			// enclosing 8-connected foreground region, -1 when the hole touches the image border
+	vector<Rect> bbox;
+
+	size_t size() const { return area.size(); }
+
+	// laid out like fitEllipse, the width is the minor axis and turns by angle
+	RotatedRect box(int i) const {
+		return RotatedRect(center[i], Size2f(minorAxis[i], majorAxis[i]), angle[i]);
+	}
+};
+
+// Labels the image in one raster pass per row strip, accumulating moments as it
+// goes; strips run in parallel and are joined along their seams afterwards.
+// Holes are listed in raster order of their first pixel.
+void measureHoles(const Mat& binary, ComponentTable& table, uint strips = 0);
+
+#endif // _COMPONENT_STATS_H_
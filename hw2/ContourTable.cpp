@@ -0,0 +1,52 @@
+#include <opencv2/imgproc/imgproc.hpp>
+#include "ContourTable.h"
+
+void ContourTable::build(const vector<vector<Point> >& contours, const vector<Vec4i>& hierarchy) {
+	size_t total = 0;
+	for(const vector<Point>& contour : contours){
+		total += contour.size();
+	}
+
+	points.clear();
+	points.reserve(total);
+	offset.assign(1, 0);
+	offset.reserve(contours.size() + 1);
+	area.clear();
+	area.reserve(contours.size());
+	parent.clear();
+	parent.reserve(contours.size());
+	bbox.clear();
+	bbox.reserve(contours.size());
+
+	for(size_t i = 0; i < contours.size(); i++){
+		add(contours[i], hierarchy[i][3]);
+	}
+}
+
+void ContourTable::add(const vector<Point>& contour, int parentIndex) {
+	points.insert(points.end(), contour.begin(), contour.end());
+	offset.push_back(points.size());
+	area.push_back(contourArea(contour));
+	parent.push_back(parentIndex);
+	bbox.push_back(boundingRect(contour));
+}
+
+Mat ContourTable::contour(int i) const {
+	return Mat(length(i), 1, CV_32SC2, (void*)&points[offset[i]]);
+}
+
+void ContourTable::draw(Mat& img, const vector<int>& indices, const Scalar& color) const {
+	vector<const Point*> heads;
+	vector<int> lengths;
+	heads.reserve(indices.size());
+	lengths.reserve(indices.size());
+	for(int i : indices){
+		if(length(i)){
+			heads.push_back(&points[offset[i]]);
+			lengths.push_back(length(i));
+		}
+	}
+	if(!heads.empty()){
+		polylines(img, heads.data(), lengths.data(), heads.size(), true, color);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef _CONTOUR_TABLE_H_
+#define _CONTOUR_TABLE_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+// Contours of one image in struct-of-arrays form. All points live in one flat
+// buffer, contour i owns points[offset[i], offset[i + 1]). Filters produce
+// index lists into the table instead of copying contours around.
+struct ContourTable {
+	vector<Point> points;
+	vector<int> offset;
+	vector<float> area;
+	vector<int> parent;
+	vector<Rect> bbox;
+
+	ContourTable() : offset(1, 0) {}
+
+	void build(const vector<vector<Point> >& contours, const vector<Vec4i>& hierarchy);
+	void add(const vector<Point>& contour, int parentIndex);
+
+	size_t size() const { return area.size(); }
+	int length(int i) const { return offset[i + 1] - offset[i]; }
+
+	// a Mat header over the points of contour i, no copy
+	Mat contour(int i) const;
+
+	void draw(Mat& img, const vector<int>& indices, const Scalar& color) const;
+};
+
+#endif // _CONTOUR_TABLE_H_
@@ -0,0 +1,154 @@
+#include <cfloat>
+#include <algorithm>
+#include "KMeans1D.h"
+
+namespace {
+
+// weighted groups in ascending order, kept as prefix sums of count, value and value squared
+struct Prefix {
+	vector<double> count, sum, square;
+
+	Prefix() : count(1, 0), sum(1, 0), square(1, 0) {}
+
+	void push(double n, double s, double q) {
+		count.push_back(count.back() + n);
+		sum.push_back(sum.back() + s);
+		square.push_back(square.back() + q);
+	}
+
+	size_t groups() const { return count.size() - 1; }
+
+	// sum of squared distances to the mean of groups [i, j)
+	double cost(size_t i, size_t j) const {
+		double n = count[j] - count[i];
+		if(n <= 0){
+			return 0;
+		}
+		double s = sum[j] - sum[i];
+		return std::max(0., (square[j] - square[i]) - s * s / n);
+	}
+
+	float mean(size_t i, size_t j) const {
+		return (sum[j] - sum[i]) / (count[j] - count[i]);
+	}
+};
+
+// best[j] = min over first < j of cost(0, first) + cost(first, j). The optimal
+// first split never moves left as j grows, which bounds each level of recursion to O(m).
+void splitRange(const Prefix& prefix, size_t jLow, size_t jHigh, size_t aLow, size_t aHigh, vector<double>& best, vector<size_t>& arg) {
+	if(jLow > jHigh){
+		return;
+	}
+	size_t j = (jLow + jHigh) / 2;
+	size_t last = std::min(aHigh, j - 1);
+	best[j] = DBL_MAX;
+	arg[j] = aLow;
+	for(size_t a = aLow; a <= last; a++){
+		double value = prefix.cost(0, a) + prefix.cost(a, j);
+		if(value < best[j]){
+			best[j] = value;
+			arg[j] = a;
+		}
+	}
+	if(j > jLow){
+		splitRange(prefix, jLow, j - 1, aLow, arg[j], best, arg);
+	}
+	splitRange(prefix, j + 1, jHigh, arg[j], aHigh, best, arg);
+}
+
+ThreeMeans solve(const Prefix& prefix) {
+	size_t m = prefix.groups();
+	ThreeMeans result;
+
+	if(m < 3){
+		//not enough distinct groups for three clusters, give each its own
+		result.smallMean = m ? prefix.mean(0, 1) : 0;
+		result.bigMean = m ? prefix.mean(m - 1, m) : 0;
+		result.middleMean = m ? prefix.mean(0, m) : 0;
+		result.distance = 0;
+		return result;
+	}
+
+	vector<double> best(m, DBL_MAX);
+	vector<size_t> arg(m, 1);
+	splitRange(prefix, 2, m - 1, 1, m - 2, best, arg);
+
+	size_t second = 2;
+	double distance = DBL_MAX;
+	for(size_t j = 2; j < m; j++){
+		double value = best[j] + prefix.cost(j, m);
+		if(value < distance){
+			distance = value;
+			second = j;
+		}
+	}
+	size_t first = arg[second];
+
+	result.smallMean = prefix.mean(0, first);
+	result.middleMean = prefix.mean(first, second);
+	result.bigMean = prefix.mean(second, m);
+	result.distance = distance;
+	return result;
+}
+
+}
+
+ThreeMeans threeMeansExact(const vector<float>& values) {
+	vector<float> sorted(values);
+	sort(sorted.begin(), sorted.end());
+
+	//values are centered so the prefix sums of squares don't lose precision
+	double center = sorted.empty() ? 0 : (sorted.front() + sorted.back()) / 2.;
+
+	//equal values always share a cluster, so they form one group
+	Prefix prefix;
+	for(size_t i = 0; i < sorted.size(); ){
+		size_t j = i;
+		while(j < sorted.size() && sorted[j] == sorted[i]){
+			j++;
+		}
+		double v = sorted[i] - center;
+		double n = j - i;
+		prefix.push(n, n * v, n * v * v);
+		i = j;
+	}
+
+	ThreeMeans result = solve(prefix);
+	result.smallMean += center;
+	result.middleMean += center;
+	result.bigMean += center;
+	return result;
+}
+
+ThreeMeans threeMeansHistogram(const vector<float>& values, int bins) {
+	if(values.empty()){
+		return solve(Prefix());
+	}
+
+	float low = *min_element(values.begin(), values.end());
+	float high = *max_element(values.begin(), values.end());
+	double center = (low + high) / 2.;
+	double width = (high - low) / bins;
+
+	vector<double> count(bins, 0), sum(bins, 0), square(bins, 0);
+	for(float value : values){
+		int bin = width > 0 ? std::min(bins - 1, (int)((value - low) / width)) : 0;
+		double v = value - center;
+		count[bin]++;
+		sum[bin] += v;
+		square[bin] += v * v;
+	}
+
+	Prefix prefix;
+	for(int bin = 0; bin < bins; bin++){
+		if(count[bin]){
+			prefix.push(count[bin], sum[bin], square[bin]);
+		}
+	}
+
+	ThreeMeans result = solve(prefix);
+	result.smallMean += center;
+	result.middleMean += center;
+	result.bigMean += center;
+	return result;
+}
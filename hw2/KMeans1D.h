@@ -0,0 +1,24 @@
+#ifndef _KMEANS_1D_H_
+#define _KMEANS_1D_H_
+
+#include <vector>
+
+using namespace std;
+
+struct ThreeMeans {
+	float smallMean;
+	float middleMean;
+	float bigMean;
+	double distance;	// within-cluster sum of squares
+};
+
+// Globally optimal 3-means of one dimensional values. In 1-D the clusters are
+// contiguous ranges of the sorted values, so the best pair of split points is
+// found with prefix sums and a divide and conquer DP in O(n log n).
+ThreeMeans threeMeansExact(const vector<float>& values);
+
+// Same, but splits only between bins of a linear histogram, O(n + bins log bins).
+// Cluster means are still exact for the chosen split.
+ThreeMeans threeMeansHistogram(const vector<float>& values, int bins = 4096);
+
+#endif // _KMEANS_1D_H_
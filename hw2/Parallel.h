@@ -0,0 +1,33 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// runs func(worker, i) for every i < count on a pool of workers threads,
+// items are handed out one at a time through an atomic counter
+template<typename Func>
+void parallelFor(size_t count, uint workers, Func func) {
+	if(!workers){
+		workers = std::max(1u, thread::hardware_concurrency());
+	}
+
+	atomic<size_t> next(0);
+	vector<thread> pool;
+	for(uint id = 0; id < workers; id++){
+		pool.emplace_back([&, id]{
+			for(size_t i = next++; i < count; i = next++){
+				func(id, i);
+			}
+		});
+	}
+	for(thread& worker : pool){
+		worker.join();
+	}
+}
+
+#endif // _PARALLEL_H_
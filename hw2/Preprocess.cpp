@@ -0,0 +1,112 @@
+#include <cfloat>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "Preprocess.h"
+#include "TiledSlide.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+//working set per band, roughly the source rows plus two grey copies
+static const size_t bandBytes = 256 * 1024;
+
+void preprocessFused(const Mat& src, Mat& dst, int border, uint workers) {
+	CV_Assert(src.type() == CV_8UC3);
+
+	int rows = src.rows, cols = src.cols;
+	int bandRows = std::max(4, std::min(rows, (int)(bandBytes / ((size_t)cols * 5 + 1))));
+	size_t bands = (rows + bandRows - 1) / bandRows;
+	if(!workers){
+		workers = std::max(1u, thread::hardware_concurrency());
+	}
+
+	dst.create(rows + 2 * border, cols + 2 * border, CV_8UC1);
+	Mat inner = dst(Rect(border, border, cols, rows));
+	Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(3, 3));
+
+	//each 3x3 step reads one halo row from the neighbouring bands; the halo rows
+	//computed inside a band are wrong at its cut edges and are dropped. Nothing
+	//image sized is kept between sweeps, sweep 2 dilates its band again
+	auto bandRange = [&](size_t band, int halo){
+		int begin = band * bandRows;
+		int end = std::min(rows, begin + bandRows);
+		return Range(std::max(0, begin - halo), std::min(rows, end + halo));
+	};
+
+	//grey + dilate of the rows of range, wrong only in the halo row at a cut edge
+	auto greyDilate = [&](Range range, Mat& step){
+		Mat grey;
+		cvtColor(src.rowRange(range), grey, COLOR_BGR2GRAY);
+		dilate(grey, step, kernel);
+	};
+
+	//sweep 1: grey + dilate, min/max
+	vector<double> minVals(workers, DBL_MAX), maxVals(workers, -DBL_MAX);
+	parallelFor(bands, workers, [&](uint id, size_t band){
+		TRACE_SPAN("grey + dilate");
+		Range core = bandRange(band, 0);
+		Range outer = bandRange(band, 1);
+		Mat step;
+		greyDilate(outer, step);
+
+		Mat result = step.rowRange(core.start - outer.start, core.end - outer.start);
+		double minVal, maxVal;
+		minMaxLoc(result, &minVal, &maxVal);
+		minVals[id] = std::min(minVals[id], minVal);
+		maxVals[id] = std::max(maxVals[id], maxVal);
+	});
+
+	double minVal = *min_element(minVals.begin(), minVals.end());
+	double maxVal = *max_element(maxVals.begin(), maxVals.end());
+	double scale = 255. * (maxVal - minVal > DBL_EPSILON ? 1. / (maxVal - minVal) : 0);
+	double shift = -minVal * scale;
+
+	//sweep 2: grey + dilate again with two halo rows, so the blur's halo row is
+	//right too, then normalize + blur into the output, histogram
+	vector<vector<size_t> > hists(workers, vector<size_t>(256, 0));
+	parallelFor(bands, workers, [&](uint id, size_t band){
+		TRACE_SPAN("normalize + blur");
+		Range core = bandRange(band, 0);
+		Range outer = bandRange(band, 1);
+		Range dilateOuter = bandRange(band, 2);
+		Mat dilated, step;
+		greyDilate(dilateOuter, dilated);
+		dilated.rowRange(outer.start - dilateOuter.start, outer.end - dilateOuter.start).convertTo(step, -1, scale, shift);
+		GaussianBlur(step, step, Size(3, 3), 0);
+
+		Mat result = inner.rowRange(core);
+		step.rowRange(core.start - outer.start, core.end - outer.start).copyTo(result);
+		vector<size_t>& hist = hists[id];
+		for(int y = 0; y < result.rows; y++){
+			const uchar* row = result.ptr<uchar>(y);
+			for(int x = 0; x < cols; x++){
+				hist[row[x]]++;
+			}
+		}
+	});
+
+	vector<size_t> hist(256, 0);
+	for(const vector<size_t>& part : hists){
+		for(int v = 0; v < 256; v++){
+			hist[v] += part[v];
+		}
+	}
+	int thresh = otsuThreshold(hist);
+
+	Mat lut(1, 256, CV_8UC1);
+	for(int v = 0; v < 256; v++){
+		lut.at<uchar>(v) = v > thresh ? 255 : 0;
+	}
+
+	//sweep 3: threshold in place, white border
+	dst.rowRange(0, border).setTo(255);
+	dst.rowRange(rows + border, rows + 2 * border).setTo(255);
+	parallelFor(bands, workers, [&](uint, size_t band){
+		TRACE_SPAN("threshold");
+		Range core = bandRange(band, 0);
+		Mat result = inner.rowRange(core);
+		LUT(result, lut, result);
+
+		Range bordered(core.start + border, core.end + border);
+		dst(bordered, Range(0, border)).setTo(255);
+		dst(bordered, Range(cols + border, cols + 2 * border)).setTo(255);
+	});
+}
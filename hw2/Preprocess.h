@@ -0,0 +1,17 @@
+#ifndef _PREPROCESS_H_
+#define _PREPROCESS_H_
+
+#include <opencv2/core/core.hpp>
+
+using namespace cv;
+
+// The hw2 chain (grey, 3x3 ellipse dilate, normalize to [0, 255], 3x3 Gaussian
+// blur, Otsu threshold, white border) in row bands sized to stay in L2, with
+// the same output as running each step on the whole image. Normalization and
+// Otsu need global statistics, so the bands are swept three times: grey +
+// dilate gathering min/max, grey + dilate again then normalize + blur gathering
+// the histogram straight into the bordered output, then threshold + border in
+// place. Only band sized buffers live besides the output.
+void preprocessFused(const Mat& src, Mat& dst, int border, uint workers = 0);
+
+#endif // _PREPROCESS_H_
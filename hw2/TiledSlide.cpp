@@ -0,0 +1,243 @@
+#include <atomic>
+#include <limits>
+#include <cfloat>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <fstream>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "TiledSlide.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+class MatSlide : public SlideSource {
+public:
+	explicit MatSlide(const Mat& image) : image(image) {}
+
+	Size size() const { return image.size(); }
+
+	Mat readGray(Rect rect) const {
+		Mat grey;
+		cvtColor(image(rect), grey, COLOR_BGR2GRAY);
+		return grey;
+	}
+
+private:
+	Mat image;
+};
+
+class PnmSlide : public SlideSource {
+public:
+	PnmSlide(const string& path, Size imageSize, int channels, streamoff dataOffset)
+		: path(path), imageSize(imageSize), channels(channels), dataOffset(dataOffset) {}
+
+	Size size() const { return imageSize; }
+
+	Mat readGray(Rect rect) const {
+		ifstream file(path, ios::binary);
+		Mat raw(rect.size(), CV_8UC(channels));
+		for(int y = 0; y < rect.height; y++){
+			file.seekg(dataOffset + ((streamoff)(rect.y + y) * imageSize.width + rect.x) * channels);
+			file.read(raw.ptr<char>(y), rect.width * channels);
+		}
+		if(!file){
+			throw runtime_error("Failed to read " + path);
+		}
+
+		if(channels == 1){
+			return raw;
+		}
+		Mat grey;
+		cvtColor(raw, grey, COLOR_RGB2GRAY);
+		return grey;
+	}
+
+private:
+	string path;
+	Size imageSize;
+	int channels;
+	streamoff dataOffset;
+};
+
+unique_ptr<SlideSource> SlideSource::open(const string& path) {
+	ifstream file(path, ios::binary);
+	string magic;
+	file >> magic;
+
+	if(magic == "P5" || magic == "P6"){
+		int values[3];
+		for(int& value : values){
+			file >> ws;
+			while(file.peek() == '#'){
+				file.ignore(numeric_limits<streamsize>::max(), '\n');
+				file >> ws;
+			}
+			file >> value;
+		}
+		//exactly one whitespace separates the header from the pixels
+		file.get();
+		if(!file || values[2] != 255){
+			return nullptr;
+		}
+		return unique_ptr<SlideSource>(new PnmSlide(path, Size(values[0], values[1]), magic == "P5" ? 1 : 3, file.tellg()));
+	}
+
+	Mat image = imread(path);
+	if(image.empty()){
+		return nullptr;
+	}
+	return unique_ptr<SlideSource>(new MatSlide(image));
+}
+
+int otsuThreshold(const vector<size_t>& hist) {
+	//same search as THRESH_OTSU in imgproc
+	size_t total = 0;
+	double mu = 0;
+	for(int i = 0; i < 256; i++){
+		total += hist[i];
+		mu += i * (double)hist[i];
+	}
+	double scale = 1. / total;
+	mu *= scale;
+
+	double mu1 = 0, q1 = 0, maxSigma = 0;
+	int maxVal = 0;
+	for(int i = 0; i < 256; i++){
+		double p_i = hist[i] * scale;
+		mu1 *= q1;
+		q1 += p_i;
+		double q2 = 1. - q1;
+
+		if(std::min(q1, q2) < FLT_EPSILON || std::max(q1, q2) > 1. - FLT_EPSILON){
+			continue;
+		}
+
+		mu1 = (mu1 + i * p_i) / q1;
+		double mu2 = (mu - q1 * mu1) / q2;
+		double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+		if(sigma > maxSigma){
+			maxSigma = sigma;
+			maxVal = i;
+		}
+	}
+
+	return maxVal;
+}
+
+static Rect expand(Rect rect, int margin, Size bounds) {
+	return Rect(rect.x - margin, rect.y - margin, rect.width + 2 * margin, rect.height + 2 * margin) & Rect(Point(0, 0), bounds);
+}
+
+// each 3x3 filter needs one pixel of halo; reading it from the slide and cropping
+// afterwards gives the same pixels as filtering the whole image
+static Mat dilatedTile(const SlideSource& slide, Rect rect) {
+	Rect outer = expand(rect, 1, slide.size());
+	Mat step = slide.readGray(outer);
+	dilate(step, step, getStructuringElement(MORPH_ELLIPSE, Size(3, 3)));
+	return step(rect - outer.tl());
+}
+
+static Mat blurredTile(const SlideSource& slide, Rect rect, double scale, double shift) {
+	Rect outer = expand(rect, 1, slide.size());
+	Mat step;
+	dilatedTile(slide, outer).convertTo(step, -1, scale, shift);
+	GaussianBlur(step, step, Size(3, 3), 0);
+	return step(rect - outer.tl());
+}
+
+void findCellsTiled(const SlideSource& slide, const TileOptions& options, int border, ContourTable& table) {
+	CV_Assert(options.tileSize > 0 && options.overlap >= 0);
+
+	Size size = slide.size();
+	uint workers = options.workers ? options.workers : std::max(1u, thread::hardware_concurrency());
+
+	vector<Rect> tiles;
+	for(int y = 0; y < size.height; y += options.tileSize){
+		for(int x = 0; x < size.width; x += options.tileSize){
+			tiles.push_back(Rect(x, y, options.tileSize, options.tileSize) & Rect(Point(0, 0), size));
+		}
+	}
+
+	//pass 1: range of the dilated grey image for normalize(NORM_MINMAX)
+	vector<double> minVals(workers, DBL_MAX), maxVals(workers, -DBL_MAX);
+	parallelFor(tiles.size(), workers, [&](uint id, size_t i){
+		TRACE_SPAN("tile range");
+		double minVal, maxVal;
+		minMaxLoc(dilatedTile(slide, tiles[i]), &minVal, &maxVal);
+		minVals[id] = std::min(minVals[id], minVal);
+		maxVals[id] = std::max(maxVals[id], maxVal);
+	});
+	double minVal = *min_element(minVals.begin(), minVals.end());
+	double maxVal = *max_element(maxVals.begin(), maxVals.end());
+	double scale = 255. * (maxVal - minVal > DBL_EPSILON ? 1. / (maxVal - minVal) : 0);
+	double shift = -minVal * scale;
+
+	//pass 2: histogram of the blurred image for Otsu
+	vector<vector<size_t> > hists(workers, vector<size_t>(256, 0));
+	parallelFor(tiles.size(), workers, [&](uint id, size_t i){
+		TRACE_SPAN("tile histogram");
+		Mat step = blurredTile(slide, tiles[i], scale, shift);
+		vector<size_t>& hist = hists[id];
+		for(int y = 0; y < step.rows; y++){
+			const uchar* row = step.ptr<uchar>(y);
+			for(int x = 0; x < step.cols; x++){
+				hist[row[x]]++;
+			}
+		}
+	});
+	vector<size_t> hist(256, 0);
+	for(const vector<size_t>& part : hists){
+		for(int v = 0; v < 256; v++){
+			hist[v] += part[v];
+		}
+	}
+	int thresh = otsuThreshold(hist);
+
+	//pass 3: contours of every tile extended by the overlap. A cell belongs to the
+	//tile whose core holds its center, and is dropped when it reaches an edge of the
+	//extended tile that lies inside the slide, as it may continue past that edge.
+	vector<vector<vector<Point> > > cells(tiles.size());
+	parallelFor(tiles.size(), workers, [&](uint, size_t i){
+		TRACE_SPAN("tile contours");
+		Rect core = tiles[i];
+		Rect extended = expand(core, options.overlap, size);
+
+		Mat step = blurredTile(slide, extended, scale, shift);
+		threshold(step, step, thresh, 255, THRESH_BINARY);
+		copyMakeBorder(step, step, border, border, border, border, BORDER_CONSTANT, CV_RGB(255, 255, 255));
+
+		vector<vector<Point> > contours;
+		vector<Vec4i> hierarchy;
+		findContours(step, contours, hierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE);
+
+		for(size_t c = 0; c < contours.size(); c++){
+			if(hierarchy[c][3] < 0){
+				continue;
+			}
+
+			Rect box = boundingRect(contours[c]) - Point(border, border) + extended.tl();
+			if((extended.x > 0 && box.x <= extended.x)
+				|| (extended.y > 0 && box.y <= extended.y)
+				|| (extended.br().x < size.width && box.br().x >= extended.br().x)
+				|| (extended.br().y < size.height && box.br().y >= extended.br().y)){
+				continue;
+			}
+			if(!core.contains(Point(box.x + box.width / 2, box.y + box.height / 2))){
+				continue;
+			}
+
+			for(Point& p : contours[c]){
+				p += extended.tl();
+			}
+			cells[i].push_back(contours[c]);
+		}
+	});
+
+	for(vector<vector<Point> >& tileCells : cells){
+		for(const vector<Point>& contour : tileCells){
+			table.add(contour, 0);
+		}
+		vector<vector<Point> >().swap(tileCells);
+	}
+}
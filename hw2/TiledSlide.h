@@ -0,0 +1,40 @@
+#ifndef _TILED_SLIDE_H_
+#define _TILED_SLIDE_H_
+
+#include <memory>
+#include <string>
+#include <opencv2/core/core.hpp>
+#include "ContourTable.h"
+
+using namespace std;
+using namespace cv;
+
+// Random access to rectangles of a slide, converted to grey on read.
+// readGray must be safe to call from several threads at once.
+class SlideSource {
+public:
+	virtual ~SlideSource() {}
+	virtual Size size() const = 0;
+	virtual Mat readGray(Rect rect) const = 0;
+
+	// binary PPM/PGM slides are streamed row by row from disk,
+	// anything else is decoded whole by imread. Returns nullptr on failure.
+	static unique_ptr<SlideSource> open(const string& path);
+};
+
+struct TileOptions {
+	int tileSize;
+	int overlap;	// must exceed the largest cell, cells are only taken from tiles that hold them entirely
+	uint workers;	// 0 for hardware concurrency
+};
+
+// Same pipeline as the whole image path (grey, dilate, normalize, blur, Otsu,
+// white border, holes of CCOMP contours), run tile by tile. Min/max and the Otsu
+// histogram come from global passes so every tile uses the same parameters.
+// Contours are stored in the coordinates of the bordered whole image.
+void findCellsTiled(const SlideSource& slide, const TileOptions& options, int border, ContourTable& table);
+
+// the threshold THRESH_OTSU would pick for this histogram
+int otsuThreshold(const vector<size_t>& hist);
+
+#endif // _TILED_SLIDE_H_
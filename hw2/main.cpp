@@ -1,29 +1,37 @@
 #include <iostream>
-#include <list>
+#include <fstream>
+#include <sstream>
+#include <mutex>
 #include <boost/format.hpp>
-#include <boost/accumulators/accumulators.hpp>
-#include <boost/accumulators/statistics/stats.hpp>
-#include <boost/accumulators/statistics/min.hpp>
-#include <boost/accumulators/statistics/max.hpp>
-#include <boost/accumulators/statistics/count.hpp>
-#include <boost/accumulators/statistics/mean.hpp>
-#include <boost/accumulators/statistics/variance.hpp>
 #include <opencv2/highgui/highgui.hpp>
-#include <opencv2/imgproc/imgproc.hpp>
+#include "CellCounter.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include "ImageLoader.h"
+#include "FileList.h"
 
 using namespace std;
-using namespace boost;
-using namespace boost::accumulators;
 using namespace cv;
 
-typedef vector<Point> Contour;
-typedef pair<Contour, float> ContourRecord;
-const int borderS = 10;
+typedef vector<string> Files;
+
+int runBatch(const Files& slides, CellOptions options, uint jobs, const string& csvPrefix);
+string csvQuote(const string& field);
 
 int main(int argc, char *argv[]) {
+	trace::init();
 	CommandLineParser cmd(argc, argv,
-		"{ 1 |      |       | Set input image }"
-		"{ h | help | false | Show this help message }"
+		"{ 1 |         |       | Set input image }"
+		"{ t | tile    | 0     | Process the image in tiles of this size, 0 for the whole image at once }"
+		"{ o | overlap | 64    | Overlap between tiles, must exceed the largest cell }"
+		"{ w | workers | 0     | Threads processing tiles or bands, 0 for hardware concurrency }"
+		"{ k | kmeans  | exact | Cell size clustering: lloyd, exact or histogram }"
+		"{ e | engine  | contours | Cell measurement: contours, or components for one pass moments without point lists }"
+		"{ f | fused   | false | Fused banded preprocessing, the intermediate windows are skipped }"
+		"{ b | batch   | false | Headless, the input is a directory or a list file of slides }"
+		"{ j | jobs    | 0     | Slides processed at once in batch mode, 0 for hardware concurrency }"
+		"{ c | csv     | cells | Prefix of the csv files written in batch mode }"
+		"{ h | help    | false | Show this help message }"
 	);
 
 	if(cmd.get<bool>("help")){
@@ -42,134 +50,147 @@ int main(int argc, char *argv[]) {
 		return EXIT_FAILURE;
 	}
 
-	Mat src = imread(inputPath);
-	if(src.empty()){
-		cout << boost::format("Failed to open %1%") % inputPath << endl;
+	CellOptions options;
+	options.tileSize = cmd.get<int>("tile");
+	options.overlap = cmd.get<int>("overlap");
+	options.workers = cmd.get<uint>("workers");
+	options.kmeans = cmd.get<string>("kmeans");
+	options.components = cmd.get<string>("engine") == "components";
+	options.fused = cmd.get<bool>("fused");
+	if(options.components && options.tileSize > 0){
+		cout << "The components engine works on whole images only" << endl;
 		return EXIT_FAILURE;
 	}
 
-	imshow("Source", src);
-
-	Mat step;
-	cvtColor(src, step, COLOR_BGR2GRAY);
-	imshow("Grey", step);
-
-	dilate(step, step, getStructuringElement(MORPH_ELLIPSE, Size(3, 3)));
-	imshow("Dilation", step);
-
-	normalize(step, step, 0, 255, NORM_MINMAX);
-	imshow("Normalize", step);
-
-	GaussianBlur(step, step, Size(3, 3), 0);
-	imshow("GaussianBlur", step);
+	if(cmd.get<bool>("batch")){
+		Files slides;
+		if(!listFiles(inputPath, slides)){
+			return EXIT_FAILURE;
+		}
+		return runBatch(slides, options, cmd.get<uint>("jobs"), cmd.get<string>("csv"));
+	}
 
-	threshold(step, step, 0, 255, THRESH_BINARY | THRESH_OTSU);
-	imshow("Threshold", step);
+	//with HW_TRACE_DUMP set the intermediate images go to files instead of windows
+	bool windows = false;
+	DebugView show;
+	if(options.tileSize <= 0){
+		show = [&](const string& title, const Mat& image){
+			if(trace::dumping()){
+				trace::dump(title, image);
+				return;
+			}
+			imshow(title, image);
+			windows = true;
+		};
+	}
 
-	copyMakeBorder(step, step, borderS, borderS, borderS, borderS, BORDER_CONSTANT, CV_RGB(255, 255, 255));
-	imshow("MakeBorder", step);
+	CellReport report;
+	if(!countCells(inputPath, options, report, show)){
+		cout << boost::format("Failed to count cells in %1%") % inputPath << endl;
+		return EXIT_FAILURE;
+	}
+	cout << boost::format("Complete K-means. Minimum valid cell size: %1%") % report.minValidSize << endl << endl;
 
-	vector<Contour> rawContours;
-	vector<Vec4i> hierarchy;
+	cout << boost::format("Total:\n\t%1% cells") % report.count << endl;
+	cout << boost::format("Max cell:\n\tArea: %1%\n\tArcLength: %2%\n\tOrientation: %3%\n\tCenter: %4%") % report.maxCell.area % report.maxCell.arcLength % report.maxCell.orientation % report.maxCell.center << endl;
+	cout << boost::format("Min cell:\n\tArea: %1%\n\tArcLength: %2%\n\tOrientation: %3%\n\tCenter: %4%") % report.minCell.area % report.minCell.arcLength % report.minCell.orientation % report.minCell.center << endl;
+	cout << boost::format("Average:\n\tCell area: %1%") % report.meanArea << endl;
 
-	findContours(step, rawContours, hierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE);
-	step = Mat::zeros(step.size(), CV_8UC1);
-	drawContours(step, rawContours, -1, CV_RGB(255, 255, 255));
-	imshow("RawContours", step);
+	if(windows){
+		waitKey();
+	}
+	return EXIT_SUCCESS;
+}
 
-	list<ContourRecord> candidateRecords;
-	for(int i = rawContours.size() - 1; i >= 0; i--){
-		if(rawContours[i].size() < 5){
-			continue;
-		}
-		if(hierarchy[i][3] >= 0){
-			candidateRecords.push_back(ContourRecord(rawContours[i], contourArea(rawContours[i])));
-		}
+int runBatch(const Files& slides, CellOptions options, uint jobs, const string& csvPrefix) {
+	//each job holds one slide at a time and at most as many wait decoded, so jobs bounds the slides in memory;
+	//the slides already keep every core busy, a job doesn't split further
+	options.verbose = false;
+	options.allCells = true;
+	if(!options.workers){
+		options.workers = 1;
 	}
 
-	// k-means part
-	accumulator_set<float, stats<tag::min, tag::max, tag::mean> > initAcc;
-	for(ContourRecord& record : candidateRecords){
-		initAcc(record.second);
+	string imagesFile = csvPrefix + "_images.csv";
+	string cellsFile = csvPrefix + "_cells.csv";
+	ofstream images(imagesFile), cells(cellsFile);
+	if(!images || !cells){
+		cerr << boost::format("Failed to write %1% or %2%") % imagesFile % cellsFile << endl;
+		return EXIT_FAILURE;
 	}
-	float smallMean = accumulators::min(initAcc);
-	float middleMean = accumulators::mean(initAcc);
-	float bigMean = accumulators::max(initAcc);
-	float distance = FLT_MAX;
-
-	cout << "Running K-means..." << endl;
-	while(true){
-		cout << boost::format("SmallMean: %1%, MiddleMean: %2%, bigMean: %3%, distance: %4%") % smallMean % middleMean % bigMean % distance << endl;
-		float smallLimit = (smallMean + middleMean) / 2;
-		float bigLimit = (middleMean + bigMean) / 2;
-		accumulator_set<float, stats<tag::count, tag::mean, tag::variance> > smallAcc;
-		accumulator_set<float, stats<tag::count, tag::mean, tag::variance> > middleAcc;
-		accumulator_set<float, stats<tag::count, tag::mean, tag::variance> > bigAcc;
-		for(ContourRecord& record : candidateRecords){
-			if(record.second < smallLimit){
-				smallAcc(record.second);
-			} else{
-				if(record.second > bigLimit){
-					bigAcc(record.second);
-				} else{
-					middleAcc(record.second);
-				}
+	images << "image,count,min_valid_size,min_area,max_area,mean_area" << endl;
+	cells << "image,cell,area,arc_length,orientation,center_x,center_y" << endl;
+
+	//slides finish in any order, their rows wait until every earlier slide is written,
+	//so the files are the same from run to run
+	mutex mtx;
+	size_t failed = 0, written = 0;
+	vector<bool> done(slides.size(), false);
+	vector<string> imageRows(slides.size()), cellRows(slides.size());
+	auto record = [&](size_t i, bool ok, const CellReport& report){
+		ostringstream imageRow, cellRow;
+		if(ok){
+			string image = csvQuote(slides[i]);
+			imageRow << boost::format("%1%,%2%,%3%,%4%,%5%,%6%") % image % report.count % report.minValidSize % report.minCell.area % report.maxCell.area % report.meanArea << '\n';
+			for(size_t c = 0; c < report.cells.size(); c++){
+				const Cell& cell = report.cells[c];
+				cellRow << boost::format("%1%,%2%,%3%,%4%,%5%,%6%,%7%") % image % c % cell.area % cell.arcLength % cell.orientation % cell.center.x % cell.center.y << '\n';
 			}
 		}
 
-		float _smallMean = accumulators::mean(smallAcc);
-		float _middleMean = accumulators::mean(middleAcc);
-		float _bigMean = accumulators::mean(bigAcc);
-		float _distance = accumulators::variance(smallAcc) * accumulators::count(smallAcc)
-						+ accumulators::variance(middleAcc) * accumulators::count(middleAcc)
-						+ accumulators::variance(bigAcc) * accumulators::count(bigAcc);
-		
-		if(distance > _distance){
-			smallMean = _smallMean;
-			middleMean = _middleMean;
-			bigMean = _bigMean;
-			distance = _distance;
-		} else{
-			break;
+		lock_guard<mutex> lock(mtx);
+		if(!ok){
+			cerr << boost::format("Failed to count cells in %1%") % slides[i] << endl;
+			failed++;
 		}
-	}
-	cout << boost::format("Complete K-means. Minimum valid cell size: %1%") % smallMean << endl << endl;
-
-	candidateRecords.remove_if([&](ContourRecord& record){
-		if(record.second < smallMean){
-			return true;
-		} else{
-			return false;
-		}
-	});
-
-	ContourRecord maxCell = *candidateRecords.begin();
-	ContourRecord minCell = maxCell;
-
-	vector<Contour> contours;
-	accumulator_set<float, stats<tag::mean> > finalAcc;
-	for(ContourRecord& record : candidateRecords){
-		if(record.second > maxCell.second){
-			maxCell = record;
+		imageRows[i] = imageRow.str();
+		cellRows[i] = cellRow.str();
+		done[i] = true;
+		for(; written < slides.size() && done[written]; written++){
+			images << imageRows[written];
+			cells << cellRows[written];
+			string().swap(imageRows[written]);
+			string().swap(cellRows[written]);
 		}
-		if(record.second < minCell.second){
-			minCell = record;
+	};
+
+	if(options.tileSize > 0){
+		//tiled slides stream their own rows
+		parallelFor(slides.size(), jobs, [&](uint, size_t i){
+			CellReport report;
+			bool ok = countCells(slides[i], options, report);
+			record(i, ok, report);
+		});
+	} else{
+		//whole slides are read and decoded ahead while the jobs count cells
+		if(!jobs){
+			jobs = std::max(1u, thread::hardware_concurrency());
 		}
-		contours.push_back(record.first);
-		finalAcc(record.second);
+		LoadOptions loadOptions;
+		loadOptions.depth = jobs;
+		ImageLoader loader(slides, loadOptions);
+		parallelFor(jobs, jobs, [&](uint, size_t){
+			LoadedImage slide;
+			while(loader.next(slide)){
+				CellReport report;
+				bool ok = !slide.image.empty() && countCells(slide.path, options, report, DebugView(), slide.image);
+				record(slide.index, ok, report);
+			}
+		});
 	}
-	RotatedRect maxBox = fitEllipse(maxCell.first);
-	RotatedRect minBox = fitEllipse(minCell.first);
 
-	step = Mat::zeros(step.size(), CV_8UC1);
-	drawContours(step, contours, -1, CV_RGB(255, 255, 255));
-	imshow("FilteredContours", step);
-
-	cout << boost::format("Total:\n\t%1% cells") % contours.size() << endl;
-	cout << boost::format("Max cell:\n\tArea: %1%\n\tArcLength: %2%\n\tOrientation: %3%\n\tCenter: %4%") % maxCell.second % arcLength(maxCell.first, true) % maxBox.angle % (maxBox.center - Point2f(borderS, borderS)) << endl;
-	cout << boost::format("Min cell:\n\tArea: %1%\n\tArcLength: %2%\n\tOrientation: %3%\n\tCenter: %4%") % minCell.second % arcLength(minCell.first, true) % minBox.angle % (minBox.center - Point2f(borderS, borderS)) << endl;
-	cout << boost::format("Average:\n\tCell area: %1%") % accumulators::mean(finalAcc) << endl;
+	cout << boost::format("Counted %1% slides, %2% failed. Results in %3% and %4%") % (slides.size() - failed) % failed % imagesFile % cellsFile << endl;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
-	waitKey();
-	return EXIT_SUCCESS;
+//quoted for csv, quotes inside doubled
+string csvQuote(const string& field) {
+	string quoted = "\"";
+	for(char c : field){
+		if(c == '"'){
+			quoted += '"';
+		}
+		quoted += c;
+	}
+	return quoted + '"';
 }
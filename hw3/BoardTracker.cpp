@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/video/tracking.hpp>
+#include "BoardTracker.h"
+#include "Trace.h"
+
+static const Size flowWindow(21, 21);
+static const int flowLevels = 3;
+
+BoardTracker::BoardTracker(Size boardSize, const TrackerOptions& options) : detector(boardSize, 1, options.levels), options(options) {
+}
+
+bool BoardTracker::next(const Mat& grey, vector<Point2f>& corners) {
+	counts.frames++;
+
+	//the pyramid of this frame is the previous one of the next, so it is built once
+	vector<Mat> pyramid;
+	buildOpticalFlowPyramid(grey, pyramid, flowWindow, flowLevels);
+
+	bool located = false;
+	bool tracking = !previousCorners.empty() && sinceKeyframe < options.keyframe;
+	if(tracking && track(pyramid, grey, corners)){
+		counts.tracked++;
+		sinceKeyframe++;
+		located = true;
+	} else{
+		TRACE_SPAN("full detection");
+		int level;
+		if(detector.find(grey, corners, level)){
+			(tracking ? counts.recovered : counts.keyframes)++;
+			sinceKeyframe = 0;
+			located = true;
+		} else{
+			counts.lost++;
+		}
+	}
+
+	previousPyramid.swap(pyramid);
+	previousCorners = located ? corners : vector<Point2f>();
+	return located;
+}
+
+bool BoardTracker::track(const vector<Mat>& pyramid, const Mat& grey, vector<Point2f>& corners) const {
+	TRACE_SPAN("track");
+	vector<uchar> status;
+	vector<float> error;
+	calcOpticalFlowPyrLK(previousPyramid, pyramid, previousCorners, corners, status, error, flowWindow, flowLevels);
+	if(count(status.begin(), status.end(), 0)){
+		return false;
+	}
+
+	vector<Point2f> flow = corners;
+	cornerSubPix(grey, corners, Size(11, 11), Size(-1, -1), TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 30, 0.1));
+	for(size_t i = 0; i < corners.size(); i++){
+		if(norm(corners[i] - flow[i]) > options.maxError){
+			return false;
+		}
+	}
+
+	//a board moves rigidly, between two close frames its corners follow one homography
+	Mat homography = findHomography(previousCorners, corners, 0);
+	if(homography.empty()){
+		return false;
+	}
+	vector<Point2f> mapped;
+	perspectiveTransform(previousCorners, mapped, homography);
+	for(size_t i = 0; i < corners.size(); i++){
+		if(norm(corners[i] - mapped[i]) > options.maxError){
+			return false;
+		}
+	}
+	return true;
+}
+
+bool collectVideoViews(const string& file, Size boardSize, const TrackerOptions& options, vector<vector<Point2f> >& views, Size& imageSize, TrackerStats& stats) {
+	VideoCapture capture(file);
+	if(!capture.isOpened()){
+		return false;
+	}
+
+	BoardTracker tracker(boardSize, options);
+	Mat frame, grey;
+	vector<Point2f> corners;
+	size_t located = 0;
+	while(capture.read(frame)){
+		TRACE_SPAN("video frame");
+		cvtColor(frame, grey, COLOR_BGR2GRAY);
+		imageSize = grey.size();
+		if(tracker.next(grey, corners) && located++ % std::max(1u, options.stride) == 0){
+			views.push_back(corners);
+		}
+	}
+
+	stats = tracker.stats();
+	return true;
+}
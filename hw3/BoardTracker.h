@@ -0,0 +1,54 @@
+#ifndef _BOARD_TRACKER_H_
+#define _BOARD_TRACKER_H_
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "ChessboardDetector.h"
+
+using namespace std;
+using namespace cv;
+
+struct TrackerOptions {
+	uint keyframe = 30;		// frames between full detections
+	uint stride = 15;		// keep every stride-th located frame as a calibration view
+	uint levels = 0;		// pyramid levels of the full detection
+	float maxError = 2.f;	// pixels a tracked corner may be off before falling back to detection
+};
+
+struct TrackerStats {
+	size_t frames = 0;
+	size_t keyframes = 0;	// located by a scheduled full detection
+	size_t tracked = 0;		// located by optical flow
+	size_t recovered = 0;	// tracking failed, located by full detection
+	size_t lost = 0;		// no board
+};
+
+// Locates the board in consecutive video frames. A full detection runs on
+// keyframes only; in between the corners of the previous frame are followed
+// with pyramidal Lucas-Kanade and snapped with cornerSubPix. A tracked board is
+// rejected, and the frame searched in full, when a point is lost, when snapping
+// moves a corner by more than maxError or when the corners stop fitting a
+// homography of the previous ones within maxError.
+class BoardTracker {
+public:
+	BoardTracker(Size boardSize, const TrackerOptions& options = TrackerOptions());
+
+	bool next(const Mat& grey, vector<Point2f>& corners);
+	const TrackerStats& stats() const { return counts; }
+
+private:
+	bool track(const vector<Mat>& pyramid, const Mat& grey, vector<Point2f>& corners) const;
+
+	ChessboardDetector detector;
+	TrackerOptions options;
+	vector<Mat> previousPyramid;
+	vector<Point2f> previousCorners;
+	uint sinceKeyframe = 0;
+	TrackerStats counts;
+};
+
+// Runs a tracker over a video and collects every stride-th located frame as a view
+bool collectVideoViews(const string& file, Size boardSize, const TrackerOptions& options, vector<vector<Point2f> >& views, Size& imageSize, TrackerStats& stats);
+
+#endif // _BOARD_TRACKER_H_
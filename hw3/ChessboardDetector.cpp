@@ -0,0 +1,176 @@
+#include <boost/thread/thread.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "ChessboardDetector.h"
+#include "Trace.h"
+
+static const int findFlags = CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE;
+static const TermCriteria subPixCriteria(TermCriteria::COUNT + TermCriteria::EPS, 30, 0.1);
+//the coarse search stops halving below this many pixels on the short side
+static const int minCoarseSide = 320;
+
+ChessboardDetector::ChessboardDetector(Size boardSize, uint workers, uint levels) : boardSize(boardSize), workers(workers), levels(levels), coarseFactor(1 << std::min(levels, 3u)) {
+	if(!this->workers){
+		this->workers = std::max(1u, boost::thread::hardware_concurrency());
+	}
+}
+
+vector<Detection> ChessboardDetector::detect(const vector<string>& files, size_t previews) const {
+	vector<Detection> results(files.size());
+	for(size_t i = 0; i < files.size(); i++){
+		results[i].file = files[i];
+	}
+
+	previews = std::min(previews, files.size());
+
+	//previews are drawn on, so only they are decoded in colour
+	LoadOptions colourOptions, greyOptions;
+	colourOptions.coarse = greyOptions.coarse = coarseFactor;
+	colourOptions.depth = greyOptions.depth = workers * 2;
+	greyOptions.flags = CV_LOAD_IMAGE_GRAYSCALE;
+	ImageLoader colourLoader(vector<string>(files.begin(), files.begin() + previews), colourOptions);
+	ImageLoader greyLoader(vector<string>(files.begin() + previews, files.end()), greyOptions);
+
+	boost::thread_group group;
+	for(uint id = 0; id < std::min<size_t>(workers, files.size()); id++){
+		group.create_thread([&]{
+			LoadedImage image;
+			while(colourLoader.next(image)){
+				detectOne(results[image.index], image, true);
+			}
+			while(greyLoader.next(image)){
+				detectOne(results[previews + image.index], image, false);
+			}
+		});
+	}
+	group.join_all();
+
+	return results;
+}
+
+void ChessboardDetector::detectOne(Detection& detection, const LoadedImage& image, bool preview) const {
+	TRACE_SPAN("detect");
+
+	Mat frame, grey, coarse;
+	if(preview){
+		frame = image.image;
+		if(!frame.empty()){
+			cvtColor(frame, grey, COLOR_BGR2GRAY);
+		}
+		if(!image.coarse.empty()){
+			cvtColor(image.coarse, coarse, COLOR_BGR2GRAY);
+		}
+	} else{
+		grey = image.image;
+		coarse = image.coarse;
+	}
+	if(grey.empty()){
+		detection.status = Detection::Unreadable;
+		return;
+	}
+
+	if(!find(grey, detection.corners, detection.level, coarse)){
+		detection.status = Detection::NotFound;
+		return;
+	}
+	detection.status = Detection::Found;
+
+	if(preview){
+		drawChessboardCorners(frame, boardSize, Mat(detection.corners), true);
+		detection.preview = frame;
+	}
+}
+
+bool ChessboardDetector::find(const Mat& grey, vector<Point2f>& corners, int& level, const Mat& coarse) const {
+	if(!findCoarse(grey, corners, level, coarse)){
+		if(!findChessboardCorners(grey, boardSize, corners, findFlags)){
+			corners.clear();
+			return false;
+		}
+		level = 0;
+	}
+	cornerSubPix(grey, corners, Size(11, 11), Size(-1, -1), subPixCriteria);
+	return true;
+}
+
+bool ChessboardDetector::findCoarse(const Mat& grey, vector<Point2f>& corners, int& level, const Mat& coarse) const {
+	//halvings worth doing, the short side has to stay above minCoarseSide
+	int top = 0;
+	for(Size size = grey.size(); top < (int)levels && std::min(size.width, size.height) / 2 >= minCoarseSide; top++){
+		size = Size((size.width + 1) / 2, (size.height + 1) / 2);
+	}
+	if(!top){
+		return false;
+	}
+
+	//levels below count, the ones in between only refine found corners
+	vector<Mat> pyramid(1, grey);
+	auto build = [&](int count){
+		while((int)pyramid.size() < count){
+			Mat down;
+			pyrDown(pyramid.back(), down);
+			pyramid.push_back(down);
+		}
+	};
+
+	TRACE_SPAN("coarse search");
+	if(!coarse.empty() && coarseFactor == 1 << top){
+		if(!findChessboardCorners(coarse, boardSize, corners, findFlags)){
+			return false;
+		}
+
+		//a loader pixel i averages full resolution pixels [f * i, f * (i + 1)), so it
+		//is centred on f * i + (f - 1) / 2, while pyrDown centres pixel j of level l
+		//on 2^l * j. Each level in between refines with a window shrunk along with the squares.
+		float shift = (coarseFactor - 1) / 2.f;
+		for(Point2f& p : corners){
+			p = p * (float)coarseFactor + Point2f(shift, shift);
+		}
+		build(top);
+		for(int l = top - 1; l > 0; l--){
+			float scale = 1 << l;
+			for(Point2f& p : corners){
+				p *= 1 / scale;
+			}
+			int half = std::max(3, 11 >> l);
+			cornerSubPix(pyramid[l], corners, Size(half, half), Size(-1, -1), subPixCriteria);
+			for(Point2f& p : corners){
+				p *= scale;
+			}
+		}
+		level = top;
+		return true;
+	}
+
+	build(top + 1);
+	if(!findChessboardCorners(pyramid[top], boardSize, corners, findFlags)){
+		return false;
+	}
+
+	//pyrDown centres pixel i of the smaller image on pixel 2i, so corners just double.
+	//Every level in between narrows the error before the full resolution refinement,
+	//with a window shrunk along with the squares.
+	for(int l = top - 1; l >= 0; l--){
+		for(Point2f& p : corners){
+			p *= 2;
+		}
+		if(l > 0){
+			int half = std::max(3, 11 >> l);
+			cornerSubPix(pyramid[l], corners, Size(half, half), Size(-1, -1), subPixCriteria);
+		}
+	}
+	level = top;
+	return true;
+}
+
+const char* ChessboardDetector::describe(Detection::Status status) {
+	switch(status){
+		case Detection::Found:
+			return "found";
+		case Detection::Unreadable:
+			return "not a valid image";
+		default:
+			return "no chessboard found";
+	}
+}
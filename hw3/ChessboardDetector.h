@@ -0,0 +1,56 @@
+#ifndef _CHESSBOARD_DETECTOR_H_
+#define _CHESSBOARD_DETECTOR_H_
+
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "ImageLoader.h"
+
+using namespace std;
+using namespace cv;
+
+struct Detection {
+	enum Status { Found, Unreadable, NotFound };
+
+	string file;
+	Status status = NotFound;
+	vector<Point2f> corners;	// refined, only when found
+	int level = -1;				// pyramid level the board was found on, 0 for full resolution
+	Mat preview;				// colour frame with the corners drawn, only for previewed files
+};
+
+// Finds the chessboard corners of a list of images on a pool of threads.
+// An ImageLoader reads and decodes ahead, grey except for the previewed files,
+// so the workers only search. Every worker writes only the slot of the image it
+// took, so the results come back in input order whatever the scheduling was.
+//
+// With pyramid levels the board is first searched on an image halved that many
+// times. Up to 8 times smaller the loader decodes that image reduced from the
+// same read, otherwise it is built with pyrDown. The corners are carried back up
+// level by level with cornerSubPix, so the last refinement runs on full
+// resolution exactly as after a full search. The full resolution image is
+// searched only when the coarse search fails.
+class ChessboardDetector {
+public:
+	ChessboardDetector(Size boardSize, uint workers = 0, uint levels = 0);
+
+	// the first previews files additionally get a Detection::preview
+	vector<Detection> detect(const vector<string>& files, size_t previews = 0) const;
+
+	// searches one grey image, corners are refined on full resolution. coarse may
+	// hold grey reduced by the loader's coarse factor, it saves building that level.
+	bool find(const Mat& grey, vector<Point2f>& corners, int& level, const Mat& coarse = Mat()) const;
+
+	static const char* describe(Detection::Status status);
+
+private:
+	void detectOne(Detection& detection, const LoadedImage& image, bool preview) const;
+	bool findCoarse(const Mat& grey, vector<Point2f>& corners, int& level, const Mat& coarse) const;
+
+	Size boardSize;
+	uint workers;
+	uint levels;
+	int coarseFactor;	// reduction asked from the loader, 2^levels up to 8
+};
+
+#endif // _CHESSBOARD_DETECTOR_H_
@@ -0,0 +1,191 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "CornerCache.h"
+
+namespace {
+
+const char magic[4] = { 'H', 'W', 'C', 'C' };
+const uint32_t version = 2;
+
+struct FileHeader {
+	char magic[4];
+	uint32_t version;
+	int32_t rows, cols;
+	uint32_t levels;
+	uint32_t count;
+};
+
+//followed by pathLength bytes of path and cornerCount pairs of floats
+struct EntryHeader {
+	uint64_t size;
+	int64_t mtime;
+	int32_t status;
+	int32_t level;
+	uint32_t pathLength;
+	uint32_t cornerCount;
+};
+
+}
+
+CornerCache::CornerCache(Size boardSize, uint levels) : boardSize(boardSize), levels(levels) {
+}
+
+bool CornerCache::load(const string& file) {
+	entries.clear();
+
+	ifstream in(file, ios::binary | ios::ate);
+	if(!in){
+		return false;
+	}
+	vector<char> data(in.tellg());
+	in.seekg(0);
+	if(!in.read(data.data(), data.size()) || data.size() < sizeof(FileHeader)){
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+	if(memcmp(header.magic, magic, sizeof(magic)) || header.version != version
+		|| header.rows != boardSize.height || header.cols != boardSize.width || header.levels != levels){
+		return false;
+	}
+
+	//a truncated or corrupt file just leaves a partial cache, the rest is detected again
+	size_t offset = sizeof(header);
+	for(uint32_t i = 0; i < header.count; i++){
+		EntryHeader entryHeader;
+		if(data.size() - offset < sizeof(entryHeader)){
+			break;
+		}
+		memcpy(&entryHeader, data.data() + offset, sizeof(entryHeader));
+		offset += sizeof(entryHeader);
+
+		size_t cornerBytes = (size_t)entryHeader.cornerCount * sizeof(Point2f);
+		if(data.size() - offset < entryHeader.pathLength + cornerBytes){
+			break;
+		}
+		string path(data.data() + offset, entryHeader.pathLength);
+		offset += entryHeader.pathLength;
+
+		//a found board has every corner and anything else none, other entries are corrupt
+		bool found = entryHeader.status == Detection::Found;
+		if((!found && entryHeader.status != Detection::NotFound)
+			|| entryHeader.cornerCount != (found ? (uint32_t)boardSize.area() : 0)){
+			offset += cornerBytes;
+			continue;
+		}
+
+		Entry& entry = entries[path];
+		entry.size = entryHeader.size;
+		entry.mtime = entryHeader.mtime;
+		entry.status = entryHeader.status;
+		entry.level = entryHeader.level;
+		entry.corners.resize(entryHeader.cornerCount);
+		memcpy(entry.corners.data(), data.data() + offset, cornerBytes);
+		entry.used = false;
+		offset += cornerBytes;
+	}
+	return true;
+}
+
+bool CornerCache::save(const string& file) const {
+	vector<char> data(sizeof(FileHeader));
+	FileHeader header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.rows = boardSize.height;
+	header.cols = boardSize.width;
+	header.levels = levels;
+	header.count = 0;
+
+	for(const auto& it : entries){
+		const Entry& entry = it.second;
+		if(!entry.used){
+			continue;
+		}
+
+		EntryHeader entryHeader;
+		entryHeader.size = entry.size;
+		entryHeader.mtime = entry.mtime;
+		entryHeader.status = entry.status;
+		entryHeader.level = entry.level;
+		entryHeader.pathLength = it.first.size();
+		entryHeader.cornerCount = entry.corners.size();
+
+		const char* bytes = (const char*)&entryHeader;
+		data.insert(data.end(), bytes, bytes + sizeof(entryHeader));
+		data.insert(data.end(), it.first.begin(), it.first.end());
+		bytes = (const char*)entry.corners.data();
+		data.insert(data.end(), bytes, bytes + entry.corners.size() * sizeof(Point2f));
+		header.count++;
+	}
+	memcpy(data.data(), &header, sizeof(header));
+
+	//write aside and rename so an interrupted run never leaves a broken cache
+	string temp = file + ".tmp";
+	bool written;
+	{
+		ofstream out(temp, ios::binary | ios::trunc);
+		written = (bool)out.write(data.data(), data.size());
+	}
+	boost::system::error_code error;
+	if(written){
+		boost::filesystem::rename(temp, file, error);
+	}
+	if(!written || error){
+		boost::filesystem::remove(temp, error);
+		return false;
+	}
+	return true;
+}
+
+bool CornerCache::lookup(Detection& detection) {
+	auto it = entries.find(detection.file);
+	if(it == entries.end()){
+		return false;
+	}
+
+	Entry& entry = it->second;
+	unsigned long long size;
+	long long mtime;
+	if(!stat(detection.file, size, mtime) || size != entry.size || mtime != entry.mtime){
+		return false;
+	}
+
+	detection.status = (Detection::Status)entry.status;
+	detection.level = entry.level;
+	detection.corners = entry.corners;
+	entry.used = true;
+	return true;
+}
+
+void CornerCache::store(const Detection& detection) {
+	if(detection.status == Detection::Unreadable){
+		return;
+	}
+
+	Entry entry;
+	if(!stat(detection.file, entry.size, entry.mtime)){
+		return;
+	}
+	entry.status = detection.status;
+	entry.level = detection.level;
+	//a failed search may leave partial corners behind, they are not worth keeping
+	if(detection.status == Detection::Found){
+		entry.corners = detection.corners;
+	}
+	entry.used = true;
+	entries[detection.file] = move(entry);
+}
+
+bool CornerCache::stat(const string& path, unsigned long long& size, long long& mtime) {
+	boost::system::error_code error;
+	size = boost::filesystem::file_size(path, error);
+	if(error){
+		return false;
+	}
+	mtime = boost::filesystem::last_write_time(path, error);
+	return !error;
+}
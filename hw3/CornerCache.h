@@ -0,0 +1,50 @@
+#ifndef _CORNER_CACHE_H_
+#define _CORNER_CACHE_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <opencv2/core/core.hpp>
+#include "ChessboardDetector.h"
+
+using namespace std;
+using namespace cv;
+
+// Detection results of earlier runs, so recalibrating only detects new or changed
+// images. An entry is keyed by path and stays valid while the file keeps its size
+// and modification time; the whole cache is dropped when the board size or the
+// number of pyramid levels searched changes, the latter decides corners and level.
+//
+// The file is a small header followed by packed entries and is loaded with a
+// single read. Only entries looked up or stored during this run are saved back,
+// so images removed from the directory fall out of the cache.
+class CornerCache {
+public:
+	explicit CornerCache(Size boardSize, uint levels = 0);
+
+	bool load(const string& file);
+	bool save(const string& file) const;
+
+	// fills status, corners and level of a found or not found detection
+	bool lookup(Detection& detection);
+	// unreadable files are not cached
+	void store(const Detection& detection);
+
+private:
+	struct Entry {
+		unsigned long long size;
+		long long mtime;
+		int status;
+		int level;
+		vector<Point2f> corners;
+		bool used;
+	};
+
+	static bool stat(const string& path, unsigned long long& size, long long& mtime);
+
+	Size boardSize;
+	uint levels;
+	unordered_map<string, Entry> entries;
+};
+
+#endif // _CORNER_CACHE_H_
@@ -0,0 +1,52 @@
+#include <vector>
+#include <algorithm>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "PerspectivePreview.h"
+#include "Trace.h"
+
+using namespace std;
+
+PerspectivePreview::PerspectivePreview(const Mat& image, int maxSide) : image(image) {
+	double scale = (double)maxSide / std::max(image.cols, image.rows);
+	if(scale < 1){
+		resize(image, proxy, Size(), scale, scale, INTER_AREA);
+	} else{
+		proxy = image;
+	}
+	buffer.create(proxy.size(), proxy.type());
+}
+
+const Mat& PerspectivePreview::preview(int height) {
+	if(height != shown){
+		TRACE_SPAN("preview warp");
+		//buffer already has the output size and type, so nothing is allocated here
+		warpPerspective(proxy, buffer, transformFor(proxy.size(), height), proxy.size());
+		shown = height;
+	}
+	return buffer;
+}
+
+Mat PerspectivePreview::render(int height) const {
+	TRACE_SPAN("warpPerspective");
+	Mat perspective;
+	warpPerspective(image, perspective, transformFor(image.size(), height), image.size());
+	return perspective;
+}
+
+Mat PerspectivePreview::transformFor(Size size, int height) {
+	Size transSize = size - Size(1, 1);
+	vector<Point2f> from {
+		Point2f(0, 0),
+		Point2f(transSize.width, 0),
+		Point2f(0, transSize.height),
+		Point2f(transSize.width, transSize.height)
+	};
+	//uniform transform, no matter height > 50 or height < 50
+	vector<Point2f> to {
+		Point2f(transSize.width * (50 - height) / 100.0, 0),
+		Point2f(transSize.width * (1 - (50 - height)/100.0), 0),
+		Point2f(transSize.width * (height - 50) / 100.0, transSize.height),
+		Point2f(transSize.width * (1 - (height - 50)/100.0), transSize.height)
+	};
+	return getPerspectiveTransform(from, to);
+}
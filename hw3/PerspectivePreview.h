@@ -0,0 +1,27 @@
+#ifndef _PERSPECTIVE_PREVIEW_H_
+#define _PERSPECTIVE_PREVIEW_H_
+
+#include <opencv2/core/core.hpp>
+
+using namespace cv;
+
+// The "Height" perspective of an image, previewed on a downscaled proxy. Previews
+// are warped into one buffer allocated up front and repeated heights are not
+// warped again; snapshots are rendered from the full resolution image.
+class PerspectivePreview {
+public:
+	explicit PerspectivePreview(const Mat& image, int maxSide = 1280);
+
+	// valid until the next call
+	const Mat& preview(int height);
+	Mat render(int height) const;
+
+	// maps the image corners so the top edge narrows by height < 50 and the bottom by height > 50
+	static Mat transformFor(Size size, int height);
+
+private:
+	Mat image, proxy, buffer;
+	int shown = -1;
+};
+
+#endif // _PERSPECTIVE_PREVIEW_H_
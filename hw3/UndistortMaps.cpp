@@ -0,0 +1,205 @@
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "UndistortMaps.h"
+#include "Trace.h"
+#include "ImageLoader.h"
+
+namespace {
+
+const char magic[4] = { 'H', 'W', 'U', 'M' };
+const uint32_t version = 1;
+//map data starts on a cache line
+const size_t alignment = 64;
+
+//followed by keyCount doubles, then map1 and map2 rows at the next alignment
+struct FileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t keyCount;
+	uint32_t reserved;
+};
+
+size_t dataOffset(size_t keyCount) {
+	size_t end = sizeof(FileHeader) + keyCount * sizeof(double);
+	return (end + alignment - 1) / alignment * alignment;
+}
+
+vector<double> makeKey(const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize) {
+	vector<double> key { (double)imageSize.width, (double)imageSize.height };
+	Mat camera, dist;
+	cameraMatrix.convertTo(camera, CV_64F);
+	distCoeffs.convertTo(dist, CV_64F);
+	key.insert(key.end(), camera.begin<double>(), camera.end<double>());
+	key.insert(key.end(), dist.begin<double>(), dist.end<double>());
+	return key;
+}
+
+}
+
+string UndistortMaps::pathFor(const string& xmlFile) {
+	return boost::filesystem::path(xmlFile).replace_extension(".maps").string();
+}
+
+void UndistortMaps::prepare(const string& file, const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize) {
+	if(load(file, cameraMatrix, distCoeffs, imageSize)){
+		cout << "Loaded undistortion maps from " << file << endl;
+		return;
+	}
+
+	compute(cameraMatrix, distCoeffs, imageSize);
+	if(save(file)){
+		cout << "Undistortion maps saved to " << file << endl;
+	} else{
+		cerr << boost::format("Failed to write undistortion maps %1%") % file << endl;
+	}
+}
+
+bool UndistortMaps::load(const string& file, const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize) {
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0){
+		return false;
+	}
+	struct stat info;
+	if(fstat(fd, &info) || (size_t)info.st_size < sizeof(FileHeader)){
+		close(fd);
+		return false;
+	}
+	size_t length = info.st_size;
+	void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED){
+		return false;
+	}
+	shared_ptr<void> region(data, [length](void* p){
+		munmap(p, length);
+	});
+
+	const char* bytes = (const char*)data;
+	FileHeader header;
+	memcpy(&header, bytes, sizeof(header));
+	vector<double> expected = makeKey(cameraMatrix, distCoeffs, imageSize);
+	size_t offset = dataOffset(header.keyCount);
+	size_t mapBytes = (size_t)imageSize.area() * (sizeof(Vec2s) + sizeof(ushort));
+	if(memcmp(header.magic, magic, sizeof(magic)) || header.version != version || header.keyCount != expected.size()
+		|| length < offset + mapBytes
+		|| memcmp(bytes + sizeof(header), expected.data(), expected.size() * sizeof(double))){
+		return false;
+	}
+
+	//read only views straight into the mapping, remap never writes to its maps
+	char* maps = const_cast<char*>(bytes) + offset;
+	map1 = Mat(imageSize, CV_16SC2, maps);
+	map2 = Mat(imageSize, CV_16UC1, maps + (size_t)imageSize.area() * sizeof(Vec2s));
+	key = expected;
+	mapping = region;
+	return true;
+}
+
+void UndistortMaps::compute(const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize) {
+	TRACE_SPAN("initUndistortRectifyMap");
+	Mat newCameraMatrix = getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1);
+	initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(), newCameraMatrix, imageSize, CV_16SC2, map1, map2);
+	key = makeKey(cameraMatrix, distCoeffs, imageSize);
+	mapping.reset();
+}
+
+bool UndistortMaps::save(const string& file) const {
+	if(map1.empty()){
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.keyCount = key.size();
+	header.reserved = 0;
+
+	vector<char> head(dataOffset(key.size()), 0);
+	memcpy(head.data(), &header, sizeof(header));
+	memcpy(head.data() + sizeof(header), key.data(), key.size() * sizeof(double));
+
+	//write aside and rename so a reader never maps a half written file
+	string temp = file + ".tmp";
+	bool written;
+	{
+		ofstream out(temp, ios::binary | ios::trunc);
+		out.write(head.data(), head.size());
+		for(const Mat* map : { &map1, &map2 }){
+			size_t rowBytes = map->cols * map->elemSize();
+			for(int y = 0; y < map->rows; y++){
+				out.write((const char*)map->ptr(y), rowBytes);
+			}
+		}
+		written = (bool)out;
+	}
+	boost::system::error_code error;
+	if(written){
+		boost::filesystem::rename(temp, file, error);
+	}
+	if(!written || error){
+		boost::filesystem::remove(temp, error);
+		return false;
+	}
+	return true;
+}
+
+void UndistortMaps::apply(const Mat& src, Mat& dst, int interpolation) const {
+	remap(src, dst, map1, map2, interpolation);
+}
+
+size_t undistortBatch(const vector<string>& files, const string& outputDir, const UndistortMaps& maps, int interpolation, uint workers) {
+	if(!workers){
+		workers = std::max(1u, boost::thread::hardware_concurrency());
+	}
+	try {
+		boost::filesystem::create_directories(outputDir);
+	} catch(const boost::filesystem::filesystem_error& ex) {
+		cerr << ex.what() << endl;
+		return 0;
+	}
+
+	//the loader reads ahead so the workers only remap and encode
+	LoadOptions loadOptions;
+	loadOptions.depth = workers * 2;
+	ImageLoader loader(files, loadOptions);
+
+	std::atomic<size_t> written(0);
+	boost::thread_group group;
+	for(uint id = 0; id < workers; id++){
+		group.create_thread([&]{
+			//remap reuses the output buffer as long as the image size stays the same
+			Mat undistorted;
+			LoadedImage raw;
+			while(loader.next(raw)){
+				TRACE_SPAN("undistort");
+				if(raw.image.empty() || raw.image.size() != maps.size()){
+					cerr << boost::format("Skipped %1%: %2%") % raw.path % (raw.image.empty() ? "not a valid image" : "size differs from the calibration") << endl;
+					continue;
+				}
+
+				maps.apply(raw.image, undistorted, interpolation);
+				string output = (boost::filesystem::path(outputDir) / boost::filesystem::path(raw.path).filename()).string();
+				if(imwrite(output, undistorted)){
+					written++;
+				} else{
+					cerr << boost::format("Failed to write %1%") % output << endl;
+				}
+			}
+		});
+	}
+	group.join_all();
+
+	return written;
+}
@@ -0,0 +1,43 @@
+#ifndef _UNDISTORT_MAPS_H_
+#define _UNDISTORT_MAPS_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace std;
+using namespace cv;
+
+// CV_16SC2 + CV_16UC1 undistortion maps of a calibration, persisted in a binary
+// file next to the calibration xml. The file records the image size and the
+// calibration it was built from and is mapped into memory on load, so a start
+// with an unchanged calibration neither recomputes nor copies the maps.
+class UndistortMaps {
+public:
+	// Calibration.xml -> Calibration.maps
+	static string pathFor(const string& xmlFile);
+
+	// loads file when it matches the calibration, otherwise computes the maps and saves them
+	void prepare(const string& file, const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize);
+
+	bool load(const string& file, const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize);
+	void compute(const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize);
+	bool save(const string& file) const;
+
+	Size size() const { return map1.size(); }
+	void apply(const Mat& src, Mat& dst, int interpolation = INTER_NEAREST) const;
+
+private:
+	Mat map1, map2;
+	vector<double> key;			// image size and calibration the maps belong to
+	shared_ptr<void> mapping;	// keeps the file mapped while map1 and map2 point into it
+};
+
+// Undistorts every file into outputDir under the same name on workers threads, each
+// reusing its output buffer. Returns the number of images written, 0 when outputDir
+// can't be created.
+size_t undistortBatch(const vector<string>& files, const string& outputDir, const UndistortMaps& maps, int interpolation, uint workers = 0);
+
+#endif // _UNDISTORT_MAPS_H_
@@ -0,0 +1,92 @@
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <opencv2/calib3d/calib3d.hpp>
+#include "ViewSelection.h"
+
+typedef Vec<float, 5> ViewFeature;
+
+static float edge(const Point2f& a, const Point2f& b) {
+	return std::max(1e-3f, (float)norm(a - b));
+}
+
+static ViewFeature describeView(const vector<Point2f>& corners, Size boardSize, Size imageSize) {
+	const Point2f& topLeft = corners[0];
+	const Point2f& topRight = corners[boardSize.width - 1];
+	const Point2f& bottomLeft = corners[(boardSize.height - 1) * boardSize.width];
+	const Point2f& bottomRight = corners.back();
+
+	Point2f center = (topLeft + topRight + bottomLeft + bottomRight) * 0.25f;
+	float area = std::abs((float)contourArea(vector<Point2f>{ topLeft, topRight, bottomRight, bottomLeft }));
+
+	//position and size relative to the image, tilt as log ratios of opposite edges
+	ViewFeature feature;
+	feature[0] = center.x / imageSize.width;
+	feature[1] = center.y / imageSize.height;
+	feature[2] = std::sqrt(area / imageSize.area());
+	feature[3] = std::log(edge(topLeft, topRight) / edge(bottomLeft, bottomRight));
+	feature[4] = std::log(edge(topLeft, bottomLeft) / edge(topRight, bottomRight));
+	return feature;
+}
+
+vector<size_t> selectViews(const vector<vector<Point2f> >& views, Size boardSize, Size imageSize, size_t count) {
+	vector<size_t> selected;
+	if(views.size() <= count){
+		for(size_t i = 0; i < views.size(); i++){
+			selected.push_back(i);
+		}
+		return selected;
+	}
+
+	vector<ViewFeature> features;
+	features.reserve(views.size());
+	for(const vector<Point2f>& corners : views){
+		features.push_back(describeView(corners, boardSize, imageSize));
+	}
+
+	//start from the view closest to the average, then repeatedly add the view
+	//farthest from everything picked so far
+	ViewFeature mean = ViewFeature::all(0);
+	for(const ViewFeature& feature : features){
+		mean += feature;
+	}
+	mean *= 1.f / features.size();
+
+	vector<float> distance(features.size());
+	for(size_t i = 0; i < features.size(); i++){
+		distance[i] = norm(features[i] - mean, NORM_L2SQR);
+	}
+	size_t next = min_element(distance.begin(), distance.end()) - distance.begin();
+	fill(distance.begin(), distance.end(), FLT_MAX);
+
+	while(selected.size() < count){
+		selected.push_back(next);
+		distance[next] = -1;
+		for(size_t i = 0; i < features.size(); i++){
+			if(distance[i] >= 0){
+				distance[i] = std::min(distance[i], (float)norm(features[i] - features[next], NORM_L2SQR));
+			}
+		}
+		next = max_element(distance.begin(), distance.end()) - distance.begin();
+	}
+
+	sort(selected.begin(), selected.end());
+	return selected;
+}
+
+double reprojectionError(const vector<Point3f>& board, const vector<vector<Point2f> >& views, const Mat& cameraMatrix, const Mat& distCoeffs) {
+	double sum = 0;
+	size_t points = 0;
+	Mat rvec, tvec;
+	vector<Point2f> projected;
+	for(const vector<Point2f>& corners : views){
+		solvePnP(board, corners, cameraMatrix, distCoeffs, rvec, tvec);
+		projectPoints(board, rvec, tvec, cameraMatrix, distCoeffs, projected);
+		for(size_t i = 0; i < corners.size(); i++){
+			Point2f d = corners[i] - projected[i];
+			sum += d.dot(d);
+		}
+		points += corners.size();
+	}
+	return points ? std::sqrt(sum / points) : 0;
+}
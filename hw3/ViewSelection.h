@@ -0,0 +1,21 @@
+#ifndef _VIEW_SELECTION_H_
+#define _VIEW_SELECTION_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+// Picks at most count views that spread over the image and over board distance
+// and tilt, so calibration cost stays bounded however many frames were taken.
+// Each view is described by the board centre, its apparent size and the ratios of
+// its opposite edges, and views are taken greedily farthest from those already
+// picked. Returns indices into views in ascending order, all of them when there
+// are no more than count.
+vector<size_t> selectViews(const vector<vector<Point2f> >& views, Size boardSize, Size imageSize, size_t count);
+
+// RMS reprojection error over all views of a calibration, each view posed with solvePnP
+double reprojectionError(const vector<Point3f>& board, const vector<vector<Point2f> >& views, const Mat& cameraMatrix, const Mat& distCoeffs);
+
+#endif // _VIEW_SELECTION_H_
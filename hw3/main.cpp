@@ -1,11 +1,19 @@
 #include <iostream>
+#include <algorithm>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
-#include <boost/thread/thread.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "ChessboardDetector.h"
+#include "CornerCache.h"
+#include "ViewSelection.h"
+#include "PerspectivePreview.h"
+#include "UndistortMaps.h"
+#include "BoardTracker.h"
+#include "Trace.h"
+#include "ImageLoader.h"
 
 using namespace cv;
 using namespace boost;
@@ -20,22 +28,34 @@ typedef vector<Point3fs> ObjectPoints;
 
 Files readDir(string& dir);
 void heightChanged(int pos, void* data);
-void doTransform(int pos, void* data, bool save = false);
 
 int main(int argc, char *argv[]) {
-	string inputDir, transformFile, xmlFile;
+	trace::init();
+	string inputDir, transformFile, xmlFile, cacheFile, undistortDir, interpolationName, videoFile;
 	int row, col, squareSize;
-	uint displayAmount;
+	uint displayAmount, workers, pyramid, maxViews;
+	bool refine;
+	TrackerOptions trackerOptions;
 
 	po::options_description desc("Options");
 	desc.add_options()
 		("image,i", po::value<string>(&inputDir), "Images directory")
+		("video,V", po::value<string>(&videoFile), "Calibrate from a video of the moving board instead of the images")
+		("keyframe,K", po::value<uint>(&trackerOptions.keyframe)->default_value(30), "Video frames between full detections, the board is tracked in between")
+		("stride,S", po::value<uint>(&trackerOptions.stride)->default_value(15), "Keep every stride-th located video frame as a view")
 		("transform,t", po::value<string>(&transformFile), "Image for perspective transformation")
 		("xml,x", po::value<string>(&xmlFile)->default_value("Calibration.xml"), "Xml file that contain calibration matrix")
+		("cache,k", po::value<string>(&cacheFile)->default_value("Corners.cache"), "Cache of detected corners, empty to disable")
 		("row,r", po::value<int>(&row)->default_value(12), "Rows of the board")
 		("col,c", po::value<int>(&col)->default_value(12), "Cows of the board")
 		("size,s", po::value<int>(&squareSize)->default_value(50), "Size of the square")
 		("display,d", po::value<uint>(&displayAmount)->default_value(2), "Amount of images to display")
+		("workers,w", po::value<uint>(&workers)->default_value(0), "Detection threads, 0 for hardware concurrency")
+		("views,v", po::value<uint>(&maxViews)->default_value(50), "Calibrate on at most this many views chosen for diversity, 0 for all")
+		("refine,f", po::bool_switch(&refine), "Refine the subset calibration on all views")
+		("undistort,u", po::value<string>(&undistortDir), "Undistort every image into this directory and exit")
+		("interpolation,n", po::value<string>(&interpolationName)->default_value("nearest"), "Undistortion interpolation: nearest or linear")
+		("pyramid,p", po::value<uint>(&pyramid)->default_value(0), "Search the board on the image halved this many times first, 0 for full resolution only")
 		("help,h", "Show this help info");
 
 	po::variables_map vm;
@@ -45,11 +65,11 @@ int main(int argc, char *argv[]) {
 			cout << desc << endl;
 			return EXIT_SUCCESS;
 		}
-		if(!vm.count("image")){
-			cout << "You need to specific input images directory" << endl;
+		if(!vm.count("image") && !vm.count("video")){
+			cout << "You need to specific input images directory or video" << endl;
 			return EXIT_FAILURE;
 		}
-		if(!vm.count("transform")){
+		if(!vm.count("transform") && !vm.count("undistort")){
 			cout << "You need to specific image for perspective transformation" << endl;
 			return EXIT_FAILURE;
 		}
@@ -60,6 +80,12 @@ int main(int argc, char *argv[]) {
 		return EXIT_FAILURE;
 	}
 
+	//batch undistortion runs without windows, and there is nothing to show without images
+	if(!undistortDir.empty() || inputDir.empty()){
+		displayAmount = 0;
+	}
+	trackerOptions.levels = pyramid;
+
 	Size boardSize(row, col);
 	cout << boost::format(
 		"Parameters:\n"
@@ -71,18 +97,28 @@ int main(int argc, char *argv[]) {
 		"\tDisplay: %6% images\n"
 	) % inputDir % transformFile % xmlFile % boardSize % squareSize % displayAmount << endl;
 
-	Files inputFiles = readDir(inputDir);
+	Files inputFiles = inputDir.empty() ? Files() : readDir(inputDir);
 	Files _inputFiles = inputFiles;
 
 	if(inputFiles.size() < displayAmount){
 		cerr << boost::format("No enough images to calibrate, you request to display is %1% images, but you only give %2% images") % displayAmount % inputFiles.size() << endl;
 		return EXIT_FAILURE;
 	}
-	Size imageSize = imread(inputFiles.back()).size();
+	Size imageSize;
+	if(!inputFiles.empty()){
+		imageSize = imread(inputFiles.back()).size();
+	} else{
+		VideoCapture capture(videoFile);
+		imageSize = Size(capture.get(CV_CAP_PROP_FRAME_WIDTH), capture.get(CV_CAP_PROP_FRAME_HEIGHT));
+	}
+
+	int interpolation = interpolationName == "linear" ? INTER_LINEAR : INTER_NEAREST;
 
 	Mat transform;
-	transform = imread(transformFile);
-	if(transform.empty()){
+	if(undistortDir.empty()){
+		transform = imread(transformFile);
+	}
+	if(undistortDir.empty() && transform.empty()){
 		cerr << boost::format("Failed to read %1% for perspective transformation") % transformFile << endl;
 		return EXIT_FAILURE;
 	}
@@ -99,89 +135,104 @@ int main(int argc, char *argv[]) {
 	if(cameraMatrix.empty() || distCoeffs.empty()){
 		cout << "Hasn't present xml file to load matrix, calibrating camera from scratch..." << endl;
 		ImagePoints imagePoints;
+		if(!videoFile.empty()){
+			TrackerStats stats;
+			if(!collectVideoViews(videoFile, boardSize, trackerOptions, imagePoints, imageSize, stats)){
+				cerr << boost::format("Failed to open video %1%") % videoFile << endl;
+				return EXIT_FAILURE;
+			}
+			cout << boost::format("Chessboard located in %1% of %2% frames, %3% kept as views") % (stats.frames - stats.lost) % stats.frames % imagePoints.size() << endl;
+			cout << boost::format("\t%1% keyframes, %2% tracked, %3% recovered by detection after tracking failed") % stats.keyframes % stats.tracked % stats.recovered << endl;
+		} else{
+			//only images that are new or changed since the cache was written are detected
+			CornerCache cache(boardSize, pyramid);
+			if(!cacheFile.empty()){
+				cache.load(cacheFile);
+			}
+			vector<Detection> detections(inputFiles.size());
+			Files misses;
+			vector<size_t> missIndex;
+			for(size_t i = 0; i < inputFiles.size(); i++){
+				detections[i].file = inputFiles[i];
+				if(!cache.lookup(detections[i])){
+					misses.push_back(inputFiles[i]);
+					missIndex.push_back(i);
+				}
+			}
+			cout << boost::format("%1% images cached, detecting %2%") % (inputFiles.size() - misses.size()) % misses.size() << endl;
+
+			ChessboardDetector detector(boardSize, workers, pyramid);
+			vector<Detection> fresh = detector.detect(misses, displayAmount);
+			for(size_t i = 0; i < fresh.size(); i++){
+				cache.store(fresh[i]);
+				detections[missIndex[i]] = move(fresh[i]);
+			}
+			if(!cacheFile.empty() && !cache.save(cacheFile)){
+				cerr << boost::format("Failed to write corner cache %1%") % cacheFile << endl;
+			}
 
-		//inline first few iteration to read image and show them
-		thread_group showGroup;
-		for(uint i = 0; i < displayAmount; i++){
-			string fileName = inputFiles.back();
-			inputFiles.pop_back();
-
-			showGroup.create_thread([&, fileName]{
-				Mat frame = imread(fileName);
-				if(frame.empty()){
-					cerr << boost::format("Failed to read %1%, not a vaild image, Abort.") % fileName << endl;
-					exit(EXIT_FAILURE);
+			//report and show on the main thread, in input order so calibration is reproducible
+			uint coarseCount = 0;
+			for(const Detection& detection : detections){
+				if(detection.status != Detection::Found){
+					cerr << boost::format("Failed to detect %1%: %2%, ignored.") % detection.file % ChessboardDetector::describe(detection.status) << endl;
+					continue;
+				}
+				imagePoints.push_back(detection.corners);
+				if(detection.level > 0){
+					coarseCount++;
 				}
 
-				Mat greyFrame;
-				cvtColor(frame, greyFrame, COLOR_BGR2GRAY);
-				Points corners;
-				if(findChessboardCorners(greyFrame, boardSize, corners, CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE)){
-					cornerSubPix(greyFrame, corners, Size(11, 11), Size(-1, -1), TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 30, 0.1));
-					drawChessboardCorners(frame, boardSize, Mat(corners), true);
-					imagePoints.push_back(corners);
-					
-					string title = "Detection - " + fileName;
+				if(!detection.preview.empty()){
+					string title = "Detection - " + detection.file;
 					namedWindow(title, WINDOW_NORMAL);
-					imshow(title, frame);
-				} else{
-					cerr << boost::format("Failed to find chessboard in %1%, Abort. The parameters may not proper.") % fileName << endl;
-					exit(EXIT_FAILURE);
+					imshow(title, detection.preview);
 				}
+			}
+			waitKey(1);
 
-				return EXIT_SUCCESS;
-			});
+			cout << boost::format("Chessboard found in %1% of %2% images") % imagePoints.size() % detections.size() << endl;
+			if(pyramid){
+				cout << boost::format("\t%1% on a pyramid level, %2% needed the full resolution search") % coarseCount % (imagePoints.size() - coarseCount) << endl;
+			}
 		}
-		showGroup.join_all();
-		waitKey(1);
-
-		//for the later iteration, finish ASAP
-		thread_group findGroup;
-		uint concurrency = thread::hardware_concurrency();
-		mutex mtx;
-		for(uint id = 0; id < concurrency; id++){
-			findGroup.create_thread([&]{
-				while(true){
-					mtx.lock();
-					if(!inputFiles.size()){
-						mtx.unlock();
-						break;
-					}
-					string fileName = inputFiles.back();
-					inputFiles.pop_back();
-					mtx.unlock();
-
-					Mat frame = imread(fileName, CV_LOAD_IMAGE_GRAYSCALE);
-					if(frame.empty()){
-						cerr << boost::format("Failed to read %1%, ignored.") % fileName << endl;
-						continue;
-					}
-
-					Points corners;
-					if(findChessboardCorners(frame, boardSize, corners, CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_FAST_CHECK | CV_CALIB_CB_NORMALIZE_IMAGE)){
-						cornerSubPix(frame, corners, Size(11, 11), Size(-1, -1), TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 30, 0.1));
-						imagePoints.push_back(corners);
-					} else{
-						cerr << boost::format("Failed to find chessboard in %1%, ignored.") % fileName << endl;
-					}
-				}
-
-				return EXIT_SUCCESS;
-			});
+		if(imagePoints.empty()){
+			cerr << "No chessboard found, can't calibrate." << endl;
+			return EXIT_FAILURE;
 		}
-		findGroup.join_all();
 
-		//do calibration
-		ObjectPoints objectPoints(1);
+		//do calibration on a bounded, diverse subset of the views
+		Point3fs board;
 		for (int i = 0; i < boardSize.height; i++) {
 			for (int j = 0; j < boardSize.width; j++){
-				objectPoints[0].push_back(Point3f(float(j * squareSize), float(i * squareSize), 0));
+				board.push_back(Point3f(float(j * squareSize), float(i * squareSize), 0));
 			}
 		}
-		objectPoints.resize(imagePoints.size(), objectPoints[0]);
+
+		ImagePoints subset;
+		for(size_t i : selectViews(imagePoints, boardSize, imageSize, maxViews ? maxViews : imagePoints.size())){
+			subset.push_back(imagePoints[i]);
+		}
+		cout << boost::format("Calibrating on %1% of %2% views") % subset.size() % imagePoints.size() << endl;
 
 		vector<Mat> rvecs, tvecs;
-		calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs, CV_CALIB_FIX_PRINCIPAL_POINT);
+		double subsetError;
+		{
+			TRACE_SPAN("calibrateCamera");
+			subsetError = calibrateCamera(ObjectPoints(subset.size(), board), subset, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs, CV_CALIB_FIX_PRINCIPAL_POINT);
+		}
+		cout << boost::format("\tReprojection error on the subset: %1%") % subsetError << endl;
+
+		if(subset.size() < imagePoints.size()){
+			if(refine){
+				TRACE_SPAN("refine");
+				double fullError = calibrateCamera(ObjectPoints(imagePoints.size(), board), imagePoints, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs, CV_CALIB_FIX_PRINCIPAL_POINT | CV_CALIB_USE_INTRINSIC_GUESS);
+				cout << boost::format("\tReprojection error after refining on all views: %1%") % fullError << endl;
+			} else{
+				TRACE_SPAN("reprojectionError");
+				cout << boost::format("\tReprojection error on all views: %1%") % reprojectionError(board, imagePoints, cameraMatrix, distCoeffs) << endl;
+			}
+		}
 
 		if(checkRange(cameraMatrix) && checkRange(distCoeffs)){
 			cout << "相机内参: " << endl;
@@ -208,39 +259,60 @@ int main(int argc, char *argv[]) {
 		cout << "Successfully load matrix from " << xmlFile << endl;
 	}
 
-	//show undistorted images
-	Mat raw, undistorted, map1, map2;
-	Mat newCameraMatrix = getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1);
-	initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(), newCameraMatrix, imageSize, CV_16SC2, map1, map2);
+	UndistortMaps maps;
+	maps.prepare(UndistortMaps::pathFor(xmlFile), cameraMatrix, distCoeffs, imageSize);
 
-	inputFiles = _inputFiles;
-	for(uint i = 0; i < displayAmount; i++){
-		string fileName = inputFiles.back();
-		inputFiles.pop_back();
+	if(!undistortDir.empty()){
+		size_t written = undistortBatch(_inputFiles, undistortDir, maps, interpolation, workers);
+		cout << boost::format("Undistorted %1% of %2% images into %3%") % written % _inputFiles.size() % undistortDir << endl;
+		return written == _inputFiles.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
-		raw = imread(fileName);
-		remap(raw, undistorted, map1, map2, INTER_NEAREST);
-		
-		string title = "Undistorted - " + fileName;
+	//show undistorted images, the last ones first, read ahead while the previous one is remapped
+	Mat undistorted;
+	Files shownFiles(_inputFiles.rbegin(), _inputFiles.rbegin() + std::min<size_t>(displayAmount, _inputFiles.size()));
+	ImageLoader loader(shownFiles);
+	LoadedImage raw;
+	while(loader.next(raw)){
+		if(raw.image.empty()){
+			continue;
+		}
+		TRACE_SPAN("undistort");
+		maps.apply(raw.image, undistorted, interpolation);
+
+		string title = "Undistorted - " + raw.path;
 		namedWindow(title, WINDOW_NORMAL);
 		imshow(title, undistorted);
 	}
 	waitKey(1);
 
-	//show perspective
+	//show perspective. The trackbar only flags a change and the loop renders the latest
+	//height, so a burst of slider events costs one warp of the proxy.
+	PerspectivePreview perspective(transform);
 	int height = 50;
+	bool changed = true;
 	namedWindow("Perspective", WINDOW_NORMAL);
-	createTrackbar("Height", "Perspective", &height, 100, heightChanged, &transform);
-	doTransform(height, &transform);
+	createTrackbar("Height", "Perspective", &height, 100, heightChanged, &changed);
 
 	cout << endl << boost::format("Interactive transforming %1%...") % transformFile << endl;
 	cout << "You can press 'q' to quit, and any other key to save an snapshot." << endl;
 	while(true){
-		char keycode = waitKey();
+		if(changed){
+			changed = false;
+			imshow("Perspective", perspective.preview(height));
+		}
+
+		int keycode = waitKey(10);
+		if(keycode < 0){
+			continue;
+		}
+		keycode &= 0xff;
 		if(keycode == 'q' || keycode == 'Q'){
 			break;
 		} else{
-			doTransform(height, &transform, true);
+			string fileName = (boost::format("Height_%1%.png") % height).str();
+			imwrite(fileName, perspective.render(height));
+			cout << "Saved: " << fileName << endl;
 		}
 	}
 
@@ -260,40 +332,12 @@ Files readDir(string& dir) {
 		exit(EXIT_FAILURE);
 	}
 
+	//directory order is unspecified, sort so runs are reproducible
+	sort(files.begin(), files.end());
+
 	return files;
 }
 
-void heightChanged(int pos, void* data){
-	doTransform(pos, data);
+void heightChanged(int, void* data){
+	*(bool*)data = true;
 }
-
-void doTransform(int pos, void* data, bool save) {
-	Mat& transform = *(Mat*)(data);
-	Mat perspective;
-
-	Size transSize = transform.size() - Size(1, 1);
-	vector<Point2f> from {
-		Point2f(0, 0),
-		Point2f(transSize.width, 0),
-		Point2f(0, transSize.height),
-		Point2f(transSize.width, transSize.height)
-	};
-	//uniform transform, no matter pos > 50 or pos < 50
-	vector<Point2f> to {
-		Point2f(transSize.width * (50 - pos) / 100.0, 0),
-		Point2f(transSize.width * (1 - (50 - pos)/100.0), 0),
-		Point2f(transSize.width * (pos - 50) / 100.0, transSize.height),
-		Point2f(transSize.width * (1 - (pos - 50)/100.0), transSize.height)
-	};
-
-	Mat trans = getPerspectiveTransform(from, to);
-	warpPerspective(transform, perspective, trans, transform.size());
-
-	if(save){
-		string fileName = (boost::format("Height_%1%.png") % pos).str();
-		imwrite(fileName, perspective);
-		cout << "Saved: " << fileName << endl;
-	} else{
-		imshow("Perspective", perspective);
-	}
-}
\ No newline at end of file
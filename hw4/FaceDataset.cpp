@@ -0,0 +1,111 @@
+#include <thread>
+#include <cstring>
+#include <iostream>
+#include <boost/format.hpp>
+#include <boost/filesystem.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "FaceDataset.h"
+#include "ImageLoader.h"
+#include "Trace.h"
+
+namespace fs = boost::filesystem;
+
+bool loadFaces(const string& dir, int limit, Size faceSize, FaceDataset& dataset, uint workers) {
+	dataset = FaceDataset();
+
+	//the listing is cheap, so it runs first and fixes every sample's row
+	try {
+		int index = 0;
+		for(auto it = fs::directory_iterator(dir); it != fs::directory_iterator(); it++){
+			if(fs::is_directory(it->path())){
+				dataset.names[index] = it->path().leaf().string();
+				int count = 1;
+				for(auto img = fs::directory_iterator(it->path()); img != fs::directory_iterator(); img++){
+					if(count++ <= limit){
+						dataset.files.push_back(img->path().string());
+						dataset.labels.push_back(index);
+					} else{
+						break;
+					}
+				}
+				index++;
+			}
+		}
+	} catch(const fs::filesystem_error& ex) {
+		cerr << ex.what() << endl;
+		return false;
+	}
+
+	size_t count = dataset.files.size();
+	if(!count){
+		return true;
+	}
+	if(!workers){
+		workers = std::max(1u, thread::hardware_concurrency());
+	}
+	LoadOptions loadOptions;
+	loadOptions.flags = CV_LOAD_IMAGE_GRAYSCALE;
+	loadOptions.depth = workers * 2;
+	ImageLoader loader(dataset.files, loadOptions);
+
+	//without a size the first readable face fixes it, the arena waits for that one
+	LoadedImage first;
+	if(faceSize.area() == 0){
+		while(loader.next(first) && first.image.empty()){
+		}
+		faceSize = first.image.size();
+	}
+	dataset.faceSize = faceSize;
+	dataset.data.create(count, faceSize.area(), CV_8UC1);
+
+	vector<char> valid(count, 0);
+	auto store = [&](const LoadedImage& loaded){
+		if(loaded.image.empty()){
+			return;
+		}
+		//the row header already has the output size and type, so resize and
+		//copyTo write into the arena without allocating
+		Mat row = dataset.face(loaded.index);
+		if(loaded.image.size() == faceSize){
+			loaded.image.copyTo(row);
+		} else{
+			resize(loaded.image, row, faceSize, 0, 0, INTER_AREA);
+		}
+		valid[loaded.index] = 1;
+	};
+	store(first);
+
+	//the loader reads and decodes ahead, the workers only resize into the arena
+	vector<thread> pool;
+	for(uint id = 0; id < workers; id++){
+		pool.emplace_back([&]{
+			LoadedImage face;
+			while(loader.next(face)){
+				TRACE_SPAN("ingest face");
+				store(face);
+			}
+		});
+	}
+	for(thread& worker : pool){
+		worker.join();
+	}
+
+	//close the gaps of unreadable files, keeping the order
+	size_t kept = 0;
+	for(size_t i = 0; i < count; i++){
+		if(!valid[i]){
+			cerr << boost::format("Failed to read %1%, ignored.") % dataset.files[i] << endl;
+			continue;
+		}
+		if(kept != i){
+			memcpy(dataset.data.ptr(kept), dataset.data.ptr(i), dataset.data.cols);
+			dataset.labels[kept] = dataset.labels[i];
+			dataset.files[kept] = dataset.files[i];
+		}
+		kept++;
+	}
+	dataset.labels.resize(kept);
+	dataset.files.resize(kept);
+	dataset.data = dataset.data.rowRange(0, kept);
+	return true;
+}
@@ -0,0 +1,34 @@
+#ifndef _FACE_DATASET_H_
+#define _FACE_DATASET_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+using namespace cv;
+
+// Every face of a gallery in one CV_8U arena, one row per sample, with the labels
+// alongside. Faces are grey and all of faceSize, so any subset of samples can be
+// handed out as Mat headers over the rows without copying pixels.
+struct FaceDataset {
+	Mat data;
+	vector<int> labels;
+	vector<string> files;
+	map<int, string> names;
+	Size faceSize;
+
+	size_t size() const { return labels.size(); }
+	// faceSize header over row i
+	Mat face(size_t i) const { return data.row(i).reshape(1, faceSize.height); }
+};
+
+// Loads up to limit faces from every sub directory of dir, one label per directory.
+// An ImageLoader reads and decodes the files ahead, grey, and workers threads resize
+// every face straight into its arena row.
+// A zero faceSize takes the size of the first face. Unreadable files are reported
+// and left out. Returns false when the directory can't be listed.
+bool loadFaces(const string& dir, int limit, Size faceSize, FaceDataset& dataset, uint workers = 0);
+
+#endif // _FACE_DATASET_H_
@@ -0,0 +1,468 @@
+#include <cmath>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "FaceModel.h"
+#include "Trace.h"
+
+namespace {
+
+const char magic[4] = { 'H', 'W', 'F', 'M' };
+const uint32_t version = 1;
+const size_t alignment = 64;
+
+//faces projected and ranked together
+const size_t blockRows = 64;
+//gallery samples ranked at once, a block's distances to them (512 KB) stay in L2
+const int galleryTile = 1024;
+//rounding allowance of the expanded squared distance, relative to the norms
+const double expansionSlack = 1e-9;
+
+enum { LabelsSection, MeanSection, EigenvectorsSection, ProjectionsSection, HistogramsSection, NamesSection, sectionCount };
+
+struct Section {
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct FileHeader {
+	char magic[4];
+	uint32_t version;
+	int32_t kind;
+	int32_t faceWidth, faceHeight;
+	int32_t radius, neighbors, gridX, gridY;
+	int32_t reserved;
+	double threshold;
+	uint64_t samples, pixels, components, bins;
+	Section sections[sectionCount];
+};
+
+//names section: per name an int32 label, a uint32 length and the bytes
+vector<char> packNames(const map<int, string>& names) {
+	vector<char> data;
+	for(const auto& it : names){
+		int32_t label = it.first;
+		uint32_t length = it.second.size();
+		data.insert(data.end(), (const char*)&label, (const char*)&label + sizeof(label));
+		data.insert(data.end(), (const char*)&length, (const char*)&length + sizeof(length));
+		data.insert(data.end(), it.second.begin(), it.second.end());
+	}
+	return data;
+}
+
+bool unpackNames(const char* data, size_t size, map<int, string>& names) {
+	size_t offset = 0;
+	while(offset < size){
+		int32_t label;
+		uint32_t length;
+		if(size - offset < sizeof(label) + sizeof(length)){
+			return false;
+		}
+		memcpy(&label, data + offset, sizeof(label));
+		memcpy(&length, data + offset + sizeof(label), sizeof(length));
+		offset += sizeof(label) + sizeof(length);
+		if(size - offset < length){
+			return false;
+		}
+		names[label] = string(data + offset, length);
+		offset += length;
+	}
+	return true;
+}
+
+//count * elemSize as bytes, false when it overflows or the count won't fit a Mat
+bool sectionBytes(uint64_t rows, uint64_t cols, uint64_t elemSize, uint64_t& bytes) {
+	const uint64_t maxSide = std::numeric_limits<int>::max();
+	if(rows > maxSide || cols > maxSide){
+		return false;
+	}
+	bytes = rows * cols;
+	if(bytes > std::numeric_limits<uint64_t>::max() / elemSize){
+		return false;
+	}
+	bytes *= elemSize;
+	return true;
+}
+
+size_t matBytes(const Mat& mat) {
+	return mat.empty() ? 0 : mat.total() * mat.elemSize();
+}
+
+//every matrix written here is continuous, they are built or cloned that way
+Mat rowsOf(const vector<Mat>& rows, int type) {
+	if(rows.empty()){
+		return Mat();
+	}
+	Mat result(rows.size(), rows[0].total(), type);
+	for(size_t i = 0; i < rows.size(); i++){
+		Mat row = result.row(i);
+		rows[i].reshape(1, 1).convertTo(row, type);
+	}
+	return result;
+}
+
+//local binary patterns and their spatial histogram, as computed by the contrib LBPH
+Mat elbp(const Mat& src, int radius, int neighbors) {
+	Mat dst = Mat::zeros(src.rows - 2 * radius, src.cols - 2 * radius, CV_32SC1);
+	for(int n = 0; n < neighbors; n++){
+		float x = static_cast<float>(radius * cos(2.0 * CV_PI * n / static_cast<float>(neighbors)));
+		float y = static_cast<float>(-radius * sin(2.0 * CV_PI * n / static_cast<float>(neighbors)));
+		int fx = static_cast<int>(floor(x));
+		int fy = static_cast<int>(floor(y));
+		int cx = static_cast<int>(ceil(x));
+		int cy = static_cast<int>(ceil(y));
+		float ty = y - fy;
+		float tx = x - fx;
+		float w1 = (1 - tx) * (1 - ty);
+		float w2 = tx * (1 - ty);
+		float w3 = (1 - tx) * ty;
+		float w4 = tx * ty;
+		for(int i = radius; i < src.rows - radius; i++){
+			for(int j = radius; j < src.cols - radius; j++){
+				float t = static_cast<float>(w1 * src.at<uchar>(i + fy, j + fx) + w2 * src.at<uchar>(i + fy, j + cx) + w3 * src.at<uchar>(i + cy, j + fx) + w4 * src.at<uchar>(i + cy, j + cx));
+				uchar center = src.at<uchar>(i, j);
+				dst.at<int>(i - radius, j - radius) += ((t > center) || (std::abs(t - center) < std::numeric_limits<float>::epsilon())) << n;
+			}
+		}
+	}
+	return dst;
+}
+
+Mat spatialHistogram(const Mat& src, int numPatterns, int gridX, int gridY) {
+	int width = src.cols / gridX;
+	int height = src.rows / gridY;
+	Mat result = Mat::zeros(gridX * gridY, numPatterns, CV_32FC1);
+	if(src.empty()){
+		return result.reshape(1, 1);
+	}
+
+	float range[] = { 0.f, static_cast<float>(numPatterns) };
+	const float* histRange = { range };
+	int row = 0;
+	for(int i = 0; i < gridY; i++){
+		for(int j = 0; j < gridX; j++){
+			Mat cell = Mat_<float>(Mat(src, Range(i * height, (i + 1) * height), Range(j * width, (j + 1) * width)));
+			Mat hist;
+			calcHist(&cell, 1, 0, Mat(), hist, 1, &numPatterns, &histRange, true, false);
+			hist /= (int)cell.total();
+			Mat resultRow = result.row(row++);
+			hist.reshape(1, 1).convertTo(resultRow, CV_32FC1);
+		}
+	}
+	return result.reshape(1, 1);
+}
+
+}
+
+FaceModel FaceModel::fromRecognizer(const Ptr<FaceRecognizer>& model, Kind kind, const map<int, string>& names, Size faceSize) {
+	FaceModel result;
+	result.type = kind;
+	result.size = faceSize;
+	result.names = names;
+	result.threshold = model->getDouble("threshold");
+	model->getMat("labels").reshape(1, 1).convertTo(result.labels, CV_32S);
+	result.labels = result.labels.reshape(1, result.labels.total());
+
+	if(kind == LBPH){
+		result.radius = model->getInt("radius");
+		result.neighbors = model->getInt("neighbors");
+		result.gridX = model->getInt("grid_x");
+		result.gridY = model->getInt("grid_y");
+		result.histograms = rowsOf(model->getMatVector("histograms"), CV_32F);
+	} else{
+		model->getMat("mean").reshape(1, 1).convertTo(result.mean, CV_64F);
+		model->getMat("eigenvectors").convertTo(result.eigenvectors, CV_64F);
+		result.projections = rowsOf(model->getMatVector("projections"), CV_64F);
+	}
+	return result;
+}
+
+bool FaceModel::save(const string& file) const {
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.kind = type;
+	header.faceWidth = size.width;
+	header.faceHeight = size.height;
+	header.radius = radius;
+	header.neighbors = neighbors;
+	header.gridX = gridX;
+	header.gridY = gridY;
+	header.threshold = threshold;
+	header.samples = labels.total();
+	header.pixels = mean.total();
+	header.components = eigenvectors.cols;
+	header.bins = histograms.cols;
+
+	vector<char> names = packNames(this->names);
+	const char* data[sectionCount] = { (const char*)labels.data, (const char*)mean.data, (const char*)eigenvectors.data,
+		(const char*)projections.data, (const char*)histograms.data, names.data() };
+	size_t sizes[sectionCount] = { matBytes(labels), matBytes(mean), matBytes(eigenvectors),
+		matBytes(projections), matBytes(histograms), names.size() };
+
+	size_t offset = sizeof(header);
+	for(int s = 0; s < sectionCount; s++){
+		offset = (offset + alignment - 1) / alignment * alignment;
+		header.sections[s].offset = offset;
+		header.sections[s].size = sizes[s];
+		offset += sizes[s];
+	}
+
+	//write aside and rename so a running server never maps a half written model
+	string temp = file + ".tmp";
+	bool written;
+	{
+		ofstream out(temp, ios::binary | ios::trunc);
+		out.write((const char*)&header, sizeof(header));
+		size_t position = sizeof(header);
+		for(int s = 0; s < sectionCount; s++){
+			vector<char> padding(header.sections[s].offset - position, 0);
+			out.write(padding.data(), padding.size());
+			out.write(data[s], sizes[s]);
+			position = header.sections[s].offset + sizes[s];
+		}
+		written = (bool)out;
+	}
+	boost::system::error_code error;
+	if(written){
+		boost::filesystem::rename(temp, file, error);
+	}
+	if(!written || error){
+		boost::filesystem::remove(temp, error);
+		return false;
+	}
+	return true;
+}
+
+bool FaceModel::load(const string& file) {
+	int fd = open(file.c_str(), O_RDONLY);
+	if(fd < 0){
+		return false;
+	}
+	struct stat info;
+	if(fstat(fd, &info) || (size_t)info.st_size < sizeof(FileHeader)){
+		close(fd);
+		return false;
+	}
+	size_t length = info.st_size;
+	void* region = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(region == MAP_FAILED){
+		return false;
+	}
+	shared_ptr<void> owner(region, [length](void* p){
+		munmap(p, length);
+	});
+
+	char* bytes = (char*)region;
+	FileHeader header;
+	memcpy(&header, bytes, sizeof(header));
+	if(memcmp(header.magic, magic, sizeof(magic)) || header.version != version){
+		return false;
+	}
+	if(header.kind != Eigenfaces && header.kind != Fisherfaces && header.kind != LBPH){
+		return false;
+	}
+
+	//the counts come from the file, so the products are checked before they are trusted
+	uint64_t expected[sectionCount];
+	if(!sectionBytes(header.samples, 1, sizeof(int32_t), expected[LabelsSection])
+		|| !sectionBytes(1, header.pixels, sizeof(double), expected[MeanSection])
+		|| !sectionBytes(header.pixels, header.components, sizeof(double), expected[EigenvectorsSection])
+		|| !sectionBytes(header.samples, header.components, sizeof(double), expected[ProjectionsSection])
+		|| !sectionBytes(header.samples, header.bins, sizeof(float), expected[HistogramsSection])){
+		return false;
+	}
+	expected[NamesSection] = header.sections[NamesSection].size;
+	for(int s = 0; s < sectionCount; s++){
+		const Section& section = header.sections[s];
+		if(section.size != expected[s] || section.offset % alignment || section.offset > length || section.size > length - section.offset){
+			return false;
+		}
+	}
+
+	map<int, string> names;
+	if(!unpackNames(bytes + header.sections[NamesSection].offset, header.sections[NamesSection].size, names)){
+		return false;
+	}
+
+	//read only views into the mapping, predict never writes to the model
+	auto view = [&](int s, int rows, int cols, int type){
+		return rows && cols ? Mat(rows, cols, type, bytes + header.sections[s].offset) : Mat();
+	};
+	type = (Kind)header.kind;
+	size = Size(header.faceWidth, header.faceHeight);
+	threshold = header.threshold;
+	radius = header.radius;
+	neighbors = header.neighbors;
+	gridX = header.gridX;
+	gridY = header.gridY;
+	this->names = names;
+	labels = view(LabelsSection, header.samples, 1, CV_32SC1);
+	mean = view(MeanSection, 1, header.pixels, CV_64FC1);
+	eigenvectors = view(EigenvectorsSection, header.pixels, header.components, CV_64FC1);
+	projections = view(ProjectionsSection, header.samples, header.components, CV_64FC1);
+	histograms = view(HistogramsSection, header.samples, header.bins, CV_32FC1);
+	mapping = owner;
+	return true;
+}
+
+void FaceModel::predict(const Mat& face, int& label, double& distance) const {
+	label = -1;
+	distance = DBL_MAX;
+
+	Mat src = face.isContinuous() ? face : face.clone();
+	if(type == LBPH){
+		Mat query = spatialHistogram(elbp(src, radius, neighbors), static_cast<int>(std::pow(2.0, static_cast<double>(neighbors))), gridX, gridY);
+		for(int i = 0; i < histograms.rows; i++){
+			double dist = compareHist(histograms.row(i), query, CV_COMP_CHISQR);
+			if(dist < distance && dist < threshold){
+				distance = dist;
+				label = labels.at<int>(i);
+			}
+		}
+	} else{
+		Mat query = subspaceProject(eigenvectors, mean, src.reshape(1, 1));
+		for(int i = 0; i < projections.rows; i++){
+			double dist = norm(projections.row(i), query, NORM_L2);
+			if(dist < distance && dist < threshold){
+				distance = dist;
+				label = labels.at<int>(i);
+			}
+		}
+	}
+}
+
+void FaceModel::predictBatch(const vector<Mat>& faces, vector<int>& predicted, vector<double>& distances, uint workers) const {
+	size_t count = faces.size();
+	predicted.assign(count, -1);
+	distances.assign(count, DBL_MAX);
+	if(!count){
+		return;
+	}
+
+	//checked here, an exception on a worker thread would terminate instead of reaching the caller
+	for(const Mat& face : faces){
+		CV_Assert(face.channels() == 1 && (type == LBPH ? face.type() == CV_8UC1 : face.total() == (size_t)eigenvectors.rows));
+	}
+
+	//|b|^2 of the gallery, shared by every block
+	Mat galleryNorms;
+	if(type != LBPH && projections.rows){
+		galleryNorms.create(projections.rows, 1, CV_64FC1);
+		for(int i = 0; i < projections.rows; i++){
+			galleryNorms.at<double>(i) = projections.row(i).dot(projections.row(i));
+		}
+	}
+
+	size_t blocks = (count + blockRows - 1) / blockRows;
+	if(!workers){
+		workers = std::max(1u, thread::hardware_concurrency());
+	}
+	workers = std::min<size_t>(workers, blocks);
+	std::atomic<size_t> next(0);
+	vector<thread> pool;
+	for(uint id = 0; id < workers; id++){
+		pool.emplace_back([&]{
+			for(size_t b = next++; b < blocks; b = next++){
+				predictBlock(faces, b * blockRows, std::min(count, (b + 1) * blockRows), galleryNorms, predicted, distances);
+			}
+		});
+	}
+	for(thread& worker : pool){
+		worker.join();
+	}
+}
+
+void FaceModel::predictBlock(const vector<Mat>& faces, size_t begin, size_t end, const Mat& galleryNorms, vector<int>& predicted, vector<double>& distances) const {
+	TRACE_SPAN("predict block");
+	if(type == LBPH){
+		for(size_t f = begin; f < end; f++){
+			predict(faces[f], predicted[f], distances[f]);
+		}
+		return;
+	}
+	if(!projections.rows){
+		return;
+	}
+
+	//centred like subspaceProject, then the whole block in one GEMM
+	int rows = end - begin;
+	Mat centred(rows, eigenvectors.rows, CV_64FC1);
+	for(int r = 0; r < rows; r++){
+		const Mat& face = faces[begin + r];
+		Mat src = face.isContinuous() ? face : face.clone();
+		Mat row = centred.row(r);
+		src.reshape(1, 1).convertTo(row, CV_64F);
+		subtract(row, mean, row);
+	}
+	Mat query;
+	gemm(centred, eigenvectors, 1.0, Mat(), 0.0, query);
+
+	//the expansion cancels, so every sample within its rounding of the best is kept
+	//as a candidate and measured exactly at the end
+	const double* norms = galleryNorms.ptr<double>();
+	double largestNorm = *std::max_element(norms, norms + projections.rows);
+	vector<double> queryNorms(rows), best(rows, DBL_MAX), slack(rows);
+	vector<vector<pair<int, double> > > candidates(rows);
+	for(int r = 0; r < rows; r++){
+		queryNorms[r] = query.row(r).dot(query.row(r));
+		slack[r] = expansionSlack * (queryNorms[r] + largestNorm);
+	}
+
+	//the gallery in tiles, -2ab for the block against one tile from one GEMM
+	Mat products;
+	for(int tile = 0; tile < projections.rows; tile += galleryTile){
+		int tileEnd = std::min(projections.rows, tile + galleryTile);
+		gemm(query, projections.rowRange(tile, tileEnd), -2.0, Mat(), 0.0, products, GEMM_2_T);
+		for(int r = 0; r < rows; r++){
+			const double* product = products.ptr<double>(r);
+			vector<pair<int, double> >& kept = candidates[r];
+			for(int i = tile; i < tileEnd; i++){
+				double squared = queryNorms[r] + norms[i] + product[i - tile];
+				if(squared > best[r] + slack[r]){
+					continue;
+				}
+				if(squared < best[r]){
+					best[r] = squared;
+					double limit = best[r] + slack[r];
+					kept.erase(remove_if(kept.begin(), kept.end(), [limit](const pair<int, double>& c){
+						return c.second > limit;
+					}), kept.end());
+				}
+				kept.push_back(make_pair(i, squared));
+			}
+		}
+	}
+
+	//candidates are in gallery order, so the rule of predict picks the same sample
+	for(int r = 0; r < rows; r++){
+		Mat q = query.row(r);
+		int& label = predicted[begin + r];
+		double& distance = distances[begin + r];
+		for(const pair<int, double>& candidate : candidates[r]){
+			int i = candidate.first;
+			double dist = norm(projections.row(i), q, NORM_L2);
+			if(dist < distance && dist < threshold){
+				distance = dist;
+				label = labels.at<int>(i);
+			}
+		}
+	}
+}
+
+string FaceModel::name(int label) const {
+	auto it = names.find(label);
+	return it == names.end() ? "unknown" : it->second;
+}
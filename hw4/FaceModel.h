@@ -0,0 +1,68 @@
+#ifndef _FACE_MODEL_H_
+#define _FACE_MODEL_H_
+
+#include <map>
+#include <cfloat>
+#include <string>
+#include <memory>
+#include <opencv2/core/core.hpp>
+#include <opencv2/contrib/contrib.hpp>
+
+using namespace std;
+using namespace cv;
+
+// The state of a trained Eigenfaces, Fisherfaces or LBPH recognizer together with
+// the label names, able to predict on its own.
+//
+// Saved as a small header followed by sections aligned to 64 bytes. load() maps the
+// file read only and points the matrices into the mapping, so a start costs no
+// parsing or copying and processes serving the same model share its pages.
+class FaceModel {
+public:
+	enum Kind { Eigenfaces = 'e', Fisherfaces = 'f', LBPH = 'l' };
+
+	// copies the trained state out of model through the Algorithm parameters
+	static FaceModel fromRecognizer(const Ptr<FaceRecognizer>& model, Kind kind, const map<int, string>& names, Size faceSize);
+
+	bool save(const string& file) const;
+	bool load(const string& file);
+
+	// same decision and distance as FaceRecognizer::predict, label -1 when
+	// nothing is closer than the threshold
+	void predict(const Mat& face, int& label, double& distance) const;
+	// predict for many faces on workers threads (0 for hardware concurrency).
+	// Eigenfaces and Fisherfaces project blocks of faces with one GEMM and rank
+	// the gallery by |a|^2 + |b|^2 - 2ab from one GEMM per gallery tile; the few
+	// candidates near the best are measured again with norm, so the decisions are
+	// those of predict and the distances agree to rounding. LBPH has no such form
+	// and runs predict per face. Faces of the wrong size throw before any work.
+	void predictBatch(const vector<Mat>& faces, vector<int>& predicted, vector<double>& distances, uint workers = 0) const;
+
+	Kind kind() const { return type; }
+	Size faceSize() const { return size; }
+	size_t samples() const { return labels.total(); }
+	// "unknown" for labels without a name, -1 included
+	string name(int label) const;
+
+private:
+	void predictBlock(const vector<Mat>& faces, size_t begin, size_t end, const Mat& galleryNorms, vector<int>& predicted, vector<double>& distances) const;
+
+	Kind type = Eigenfaces;
+	Size size;
+	double threshold = DBL_MAX;
+	map<int, string> names;
+	Mat labels;			// CV_32SC1, one per sample
+
+	//Eigenfaces and Fisherfaces, CV_64F
+	Mat mean;			// 1 x pixels
+	Mat eigenvectors;	// pixels x components
+	Mat projections;	// samples x components
+
+	//LBPH
+	int radius = 1, neighbors = 8, gridX = 8, gridY = 8;
+	Mat histograms;		// CV_32F, samples x (gridX * gridY * 2^neighbors)
+
+	shared_ptr<void> mapping;	// keeps the file mapped while the matrices point into it
+};
+
+#endif // _FACE_MODEL_H_
@@ -1,29 +1,36 @@
 #include <iostream>
+#include <numeric>
 #include <algorithm>
-#include <boost/timer.hpp>
 #include <boost/format.hpp>
 #include <boost/filesystem.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/contrib/contrib.hpp>
+#include "Trace.h"
+#include "FaceDataset.h"
+#include "FaceModel.h"
 
 using namespace std;
 using namespace boost;
 using namespace filesystem;
 using namespace cv;
 
-typedef tuple<Mat, int> Sample;
-
 void logTime(const string& message);
 
 int main(int argc, char *argv[]) {
+	trace::init();
 	logTime("Launched");
 
 	CommandLineParser cmd(argc, argv,
-		"{ 1 |       |       | Photos directory }"
-		"{ t | test  | 10    | Test set size }"
+		"{ 1 |       |       | Photos directory, one sub directory per label; with --load only the photos to predict }"
+		"{ t | test  | 10    | Test set size, with --load every photo is predicted }"
 		"{ l | limit | 10    | Max samples for each label }"
 		"{ m | model | e     | e(Eigenfaces)/f(Fisherfaces)/l(LBPH) }"
 		"{ d | dim   | 100   | Dimension of PCA, only for Eigenfaces }"
+		"{ W | width | 0     | Face width all samples are resized to, 0 for the first sample's }"
+		"{ H | height | 0    | Face height all samples are resized to, 0 for the first sample's }"
+		"{ s | save  |       | Save the trained model to this file }"
+		"{ L | load  |       | Predict with a saved model instead of training one }"
+		"{ w | workers | 0   | Threads predicting the test set, 0 for hardware concurrency }"
 		"{ h | help  | false | Show this help message }"
 	);
 
@@ -39,31 +46,41 @@ int main(int argc, char *argv[]) {
 	int limit = cmd.get<int>("limit");
 	char modelName = cmd.get<string>("model").front();
 	int dim = cmd.get<int>("dim");
-	vector<Sample> samples;
-	map<int, string> names;
-
-	try {
-		int index = 0;
-		for(auto it = directory_iterator(inputDir); it != directory_iterator(); it++){
-			if(is_directory(it->path())){
-				names[index] = it->path().leaf().string();
-				int count = 1;
-				for(auto img = directory_iterator(it->path().string()); img != directory_iterator(); img++){
-					if(count++ <= limit){
-						samples.push_back(Sample(imread(img->path().string(), CV_LOAD_IMAGE_GRAYSCALE), index));
-					} else{
-						break;
-					}
-				}
-				index++;
-			}
+	string modelFile = cmd.get<string>("load");
+	string saveFile = cmd.get<string>("save");
+	Size faceSize(cmd.get<int>("width"), cmd.get<int>("height"));
+	uint workers = cmd.get<uint>("workers");
+
+	//a saved model fixes the kind and the face size
+	FaceModel faceModel;
+	if(!modelFile.empty()){
+		TRACE_SPAN("load model");
+		if(!faceModel.load(modelFile)){
+			cerr << boost::format("Failed to load model %1%") % modelFile << endl;
+			exit(EXIT_FAILURE);
+		}
+		modelName = faceModel.kind();
+		faceSize = faceModel.faceSize();
+		logTime("Model loaded");
+	}
+
+	FaceDataset dataset;
+	{
+		TRACE_SPAN("load samples");
+		if(!loadFaces(inputDir, limit, faceSize, dataset)){
+			exit(EXIT_FAILURE);
+		}
+	}
+	const map<int, string>& names = dataset.names;
+
+	//predict-only runs get just the queries, nothing is split off or trained
+	bool predictOnly = !modelFile.empty();
+	if(predictOnly){
+		numTestCase = dataset.size();
+		if(!numTestCase){
+			cerr << boost::format("No photos to predict in %1%") % inputDir << endl;
+			exit(EXIT_FAILURE);
 		}
-	} catch(filesystem_error& ex) {
-		cerr << ex.what() << endl;
-		exit(EXIT_FAILURE);
-	} catch (Exception& ex) {
-		cerr << ex.what() << endl;
-		exit(EXIT_FAILURE);
 	}
 
 	cout << boost::format(
@@ -74,7 +91,7 @@ int main(int argc, char *argv[]) {
 		"\tSample labels: %4%\n"
 		"\tMax Sample per label: %5%\n"
 		"\tModel Use: %6%\n"
-	) % inputDir % (samples.size() - numTestCase) % numTestCase % names.size() % limit % modelName;
+	) % inputDir % (predictOnly ? faceModel.samples() : dataset.size() - numTestCase) % numTestCase % names.size() % limit % modelName;
 
 	if(modelName == 'e'){
 		cout << boost::format("\tDimension: %1%\n") % dim << endl;
@@ -82,66 +99,91 @@ int main(int argc, char *argv[]) {
 		cout << endl;
 	}
 
-	if(names.size() <= numTestCase) {
+	if(!predictOnly && names.size() <= numTestCase) {
 		cerr << boost::format("No enough photos, you request %1% test cases, but the photos only have %2% labels") % numTestCase % names.size() << endl;
 		exit(EXIT_FAILURE);
 	}
 
-	shuffle(samples.begin(), samples.end(), default_random_engine(time(NULL)));
+	//split by shuffling indices, the images are headers over the dataset rows
+	vector<size_t> order(dataset.size());
+	iota(order.begin(), order.end(), 0);
+	if(!predictOnly){
+		shuffle(order.begin(), order.end(), default_random_engine(time(NULL)));
+	}
 
 	vector<Mat> images, testImages;
 	vector<int> labels, testLabels;
-
-	uint sampleSize = samples.size();
-	for(uint i = 0; i < sampleSize; i++){
+	for(size_t i = 0; i < order.size(); i++){
 		if(i < numTestCase){
-			testImages.push_back(get<0>(samples[i]));
-			testLabels.push_back(get<1>(samples[i]));
+			testImages.push_back(dataset.face(order[i]));
+			testLabels.push_back(dataset.labels[order[i]]);
 		} else{
-			images.push_back(get<0>(samples[i]));
-			labels.push_back(get<1>(samples[i]));
+			images.push_back(dataset.face(order[i]));
+			labels.push_back(dataset.labels[order[i]]);
 		}
 	}
 
-	Ptr<FaceRecognizer> model;
-	switch(modelName){
-		case 'e':
-			model = createEigenFaceRecognizer(dim);
-			break;
-		case 'f':
-			model = createFisherFaceRecognizer();
-			break;
-		case 'l':
-			model = createLBPHFaceRecognizer();
-			break;
-		default:
-			cerr << "Unknown model" << endl;
-			exit(EXIT_FAILURE);
-	}
+	if(!predictOnly){
+		Ptr<FaceRecognizer> model;
+		switch(modelName){
+			case 'e':
+				model = createEigenFaceRecognizer(dim);
+				break;
+			case 'f':
+				model = createFisherFaceRecognizer();
+				break;
+			case 'l':
+				model = createLBPHFaceRecognizer();
+				break;
+			default:
+				cerr << "Unknown model" << endl;
+				exit(EXIT_FAILURE);
+		}
 
-	logTime("Before training");
-	model->train(images, labels);
-	logTime("After training");
+		logTime("Before training");
+		{
+			TRACE_SPAN("train");
+			model->train(images, labels);
+		}
+		logTime("After training");
+
+		faceModel = FaceModel::fromRecognizer(model, (FaceModel::Kind)modelName, names, dataset.faceSize);
+		if(!saveFile.empty()){
+			if(faceModel.save(saveFile)){
+				cout << "Model saved to " << saveFile << endl;
+			} else{
+				cerr << boost::format("Failed to save model %1%") % saveFile << endl;
+			}
+		}
+	}
 
 	int correct = 0;
 	logTime("Before predication");
+	vector<int> predicates;
+	vector<double> confidences;
+	{
+		TRACE_SPAN("predict");
+		faceModel.predictBatch(testImages, predicates, confidences, workers);
+	}
 	for(uint i = 0; i < numTestCase; i++){
-		int predicate;
-		double confidence;
-		model->predict(testImages[i], predicate, confidence);
-		cout << boost::format("Predicate: %1%, Actual: %2%, Confidence: %3%") % names[predicate] % names[testLabels[i]] % confidence << endl;
+		//compared by name, a loaded model may number the labels differently
+		string predicted = faceModel.name(predicates[i]);
+		string actual = names.at(testLabels[i]);
+		cout << boost::format("Predicate: %1%, Actual: %2%, Confidence: %3%") % predicted % actual % confidences[i] << endl;
 
-		if(predicate == testLabels[i]){
+		if(predicted == actual){
 			correct++;
 		}
 
-		string text = (boost::format("%1%/%2%") % names[predicate] % names[testLabels[i]]).str();
-		Point pos(testImages[i].size().width * 0.02, testImages[i].size().height * 0.98);
-		putText(testImages[i], text, pos,  FONT_HERSHEY_SIMPLEX, 0.5, CV_RGB(255, 255, 255));
+		//annotate a copy, the test image is a row of the dataset
+		Mat shown = testImages[i].clone();
+		string text = (boost::format("%1%/%2%") % predicted % actual).str();
+		Point pos(shown.size().width * 0.02, shown.size().height * 0.98);
+		putText(shown, text, pos,  FONT_HERSHEY_SIMPLEX, 0.5, CV_RGB(255, 255, 255));
 
 		string title = "Test Case - " + to_string(i);
 		namedWindow(title, WINDOW_NORMAL);
-		imshow(title, testImages[i]);
+		imshow(title, shown);
 	}
 	cout << "Accuracy: " << (100.0 * correct / numTestCase) << '%' << endl;
 	logTime("Finished");
@@ -150,7 +192,7 @@ int main(int argc, char *argv[]) {
 	return EXIT_SUCCESS;
 }
 
+//wall clock seconds on the same time base as the trace spans
 void logTime(const string& message) {
-	static timer t;
-	cout << boost::format("[%1%] %2%") % t.elapsed() % message << endl;
+	cout << boost::format("[%1%] %2%") % (trace::now() / 1e9) % message << endl;
 }